@@ -0,0 +1,182 @@
+//counts heap allocations per subsystem, only compiled in with -DTRACK_ALLOCATIONS
+//allocations go to whatever ALLOC_SUBSYSTEM scope is innermost on the allocating thread, frees to the freeing one
+
+enum {
+  allocSubsystem_other,
+  allocSubsystem_movegen,
+  allocSubsystem_uci,
+  allocSubsystem_rendering,
+  allocSubsystem_gameLoop,
+  numAllocSubsystems
+};
+
+#ifdef TRACK_ALLOCATIONS
+
+#include <new>
+#include <atomic>
+
+const char* allocSubsystemNames[numAllocSubsystems] = {
+  "other",
+  "movegen",
+  "uci io",
+  "rendering",
+  "game loop",
+};
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+extern "C" void* __libc_memalign(size_t alignment, size_t size);
+extern "C" void __libc_free(void* ptr);
+
+std::atomic<long long> allocCounts[numAllocSubsystems];
+std::atomic<long long> allocBytes[numAllocSubsystems];
+std::atomic<long long> freeCounts[numAllocSubsystems];
+bool allocForbidden[numAllocSubsystems];
+
+thread_local int currentAllocSubsystem = allocSubsystem_other;
+
+void
+recordAllocation(size_t size){
+  int subsystem = currentAllocSubsystem;
+  allocCounts[subsystem].fetch_add(1, std::memory_order_relaxed);
+  allocBytes[subsystem].fetch_add(size, std::memory_order_relaxed);
+  if(allocForbidden[subsystem]){
+    //no printf here, it can allocate
+    const char msg[] = "heap allocation in a subsystem marked allocation free: ";
+    write(2, msg, sizeof(msg)-1);
+    write(2, allocSubsystemNames[subsystem], strlen(allocSubsystemNames[subsystem]));
+    write(2, "\n", 1);
+    abort();
+  }
+}
+
+void
+recordFree(void* ptr){
+  if(ptr != NULL){
+    freeCounts[currentAllocSubsystem].fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+extern "C" void*
+malloc(size_t size){
+  recordAllocation(size);
+  return __libc_malloc(size);
+}
+
+extern "C" void*
+calloc(size_t count, size_t size){
+  recordAllocation(count*size);
+  return __libc_calloc(count, size);
+}
+
+extern "C" void*
+realloc(void* ptr, size_t size){
+  recordAllocation(size);
+  return __libc_realloc(ptr, size);
+}
+
+extern "C" void
+free(void* ptr){
+  recordFree(ptr);
+  __libc_free(ptr);
+}
+
+void*
+trackedNew(size_t size, size_t alignment){
+  recordAllocation(size);
+  void* ptr = (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) ? __libc_memalign(alignment, size) : __libc_malloc(size);
+  if(ptr == NULL){
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void* operator new(size_t size){ return trackedNew(size, 0); }
+void* operator new[](size_t size){ return trackedNew(size, 0); }
+void* operator new(size_t size, std::align_val_t alignment){ return trackedNew(size, (size_t)alignment); }
+void* operator new[](size_t size, std::align_val_t alignment){ return trackedNew(size, (size_t)alignment); }
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete[](void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { free(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { free(ptr); }
+
+class allocSubsystemScope {
+public:
+  int previous;
+
+  allocSubsystemScope(int subsystem){
+    previous = currentAllocSubsystem;
+    currentAllocSubsystem = subsystem;
+  }
+
+  ~allocSubsystemScope(void){
+    currentAllocSubsystem = previous;
+  }
+};
+
+#define ALLOC_SUBSYSTEM(subsystem) allocSubsystemScope allocSubsystemScope_##subsystem(subsystem)
+
+class allocSnapshot {
+public:
+  long long counts[numAllocSubsystems];
+  long long bytes[numAllocSubsystems];
+  long long frees[numAllocSubsystems];
+};
+
+allocSnapshot
+takeAllocSnapshot(void){
+  allocSnapshot snapshot;
+  for(int i = 0; i < numAllocSubsystems; i++){
+    snapshot.counts[i] = allocCounts[i];
+    snapshot.bytes[i] = allocBytes[i];
+    snapshot.frees[i] = freeCounts[i];
+  }
+  return snapshot;
+}
+
+bool
+forbidAllocations(const char* subsystemName){
+  for(int i = 0; i < numAllocSubsystems; i++){
+    if(strcmp(allocSubsystemNames[i], subsystemName) == 0){
+      allocForbidden[i] = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+//everything allocated since "since", divided by units (moves, nodes...) when units > 0
+void
+printAllocationsSince(allocSnapshot* since, long long units, const char* unitName){
+  allocSnapshot now = takeAllocSnapshot();
+  printf("%-12s %12s %14s %12s", "subsystem", "allocs", "bytes", "frees");
+  if(units > 0){
+    printf(" %14s %14s", "allocs/", "bytes/");
+    printf(" (per %s, %lld)", unitName, units);
+  }
+  printf("\n");
+  for(int i = 0; i < numAllocSubsystems; i++){
+    long long count = now.counts[i]-since->counts[i];
+    long long bytes = now.bytes[i]-since->bytes[i];
+    long long frees = now.frees[i]-since->frees[i];
+    if((count == 0)&&(frees == 0)){
+      continue;
+    }
+    printf("%-12s %12lld %14lld %12lld", allocSubsystemNames[i], count, bytes, frees);
+    if(units > 0){
+      printf(" %14.2f %14.1f", count*1.0/units, bytes*1.0/units);
+    }
+    printf("\n");
+  }
+}
+
+#else
+
+#define ALLOC_SUBSYSTEM(subsystem)
+
+#endif
@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <ctype.h>
+#include <assert.h>
+
+#include "startupProfile.cpp"
+#include "perfCounters.cpp"
+#include "allocTracker.cpp"
+#include "trace.cpp"
+#include "chessLogic.cpp"
+#include "timeManager.cpp"
+#include "chessEngine.cpp"
+#include "positionBatch.cpp"
+#include "nnue.cpp"
+#include "benchmark.cpp"
+#include "threadPool.cpp"
+#include "perftBatch.cpp"
+
+void
+printBenchUsage(void){
+  printf("usage: bench [--suite micro|perft|selfplay|all] [--samples N] [--perft-samples N] [--games N] [--warmup N]\n");
+  printf("             [--min-sample-ms N] [--filter name]\n");
+  printf("             [--save-baseline file.json] [--compare file.json [--threshold percent] [--alpha p]]\n");
+#ifdef TRACK_ALLOCATIONS
+  printf("             [--forbid-allocations subsystem]\n");
+#endif
+  printf("       bench --perft-stats depth [--divide] [--fen fen]\n");
+  printf("       bench --perft-batch file.epd [--depth N] [--threads N] [--out results.jsonl] [--mismatches mismatches.jsonl]\n");
+  printf("       bench --check-batch N | --check-incremental N | --label file.epd\n");
+  printf("       bench --write-random-net file.nnue | --check-nnue file.nnue [--positions N]\n");
+  printf("exit code is 1 on errors or perft mismatches, 2 if --compare found a significant slowdown\n");
+}
+
+int
+main(int argc, char* argv[])
+{
+  benchConfig config;
+  const char* suite = "all";
+  const char* saveBaselineFile = NULL;
+  const char* compareFile = NULL;
+  double thresholdPercent = 5;
+  double alpha = 0.01;
+  int perftStatsDepth = 0;
+  bool divide = false;
+  const char* fen = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+  const char* perftBatchFile = NULL;
+  perftBatchConfig batchConfig;
+  int checkBatchCount = 0;
+  int checkIncrementalCount = 0;
+  const char* randomNetFile = NULL;
+  const char* checkNnueFile = NULL;
+  int nnuePositions = 20000;
+  const char* labelFile = NULL;
+  for(int i = 1; i < argc; i++){
+    bool hasValue = (i+1 < argc);
+    if((strcmp(argv[i], "--suite") == 0)&&hasValue){
+      suite = argv[++i];
+    }else if((strcmp(argv[i], "--samples") == 0)&&hasValue){
+      config.samples = atoi(argv[++i]);
+    }else if((strcmp(argv[i], "--perft-samples") == 0)&&hasValue){
+      config.perftSamples = atoi(argv[++i]);
+    }else if((strcmp(argv[i], "--games") == 0)&&hasValue){
+      config.selfPlayGames = atoi(argv[++i]);
+    }else if((strcmp(argv[i], "--warmup") == 0)&&hasValue){
+      config.warmupSamples = atoi(argv[++i]);
+    }else if((strcmp(argv[i], "--min-sample-ms") == 0)&&hasValue){
+      config.minSampleNanoseconds = atof(argv[++i])*1e6;
+    }else if((strcmp(argv[i], "--filter") == 0)&&hasValue){
+      config.filter = argv[++i];
+    }else if((strcmp(argv[i], "--save-baseline") == 0)&&hasValue){
+      saveBaselineFile = argv[++i];
+    }else if((strcmp(argv[i], "--compare") == 0)&&hasValue){
+      compareFile = argv[++i];
+    }else if((strcmp(argv[i], "--threshold") == 0)&&hasValue){
+      thresholdPercent = atof(argv[++i]);
+    }else if((strcmp(argv[i], "--alpha") == 0)&&hasValue){
+      alpha = atof(argv[++i]);
+    }else if((strcmp(argv[i], "--perft-stats") == 0)&&hasValue){
+      perftStatsDepth = atoi(argv[++i]);
+    }else if(strcmp(argv[i], "--divide") == 0){
+      divide = true;
+    }else if((strcmp(argv[i], "--fen") == 0)&&hasValue){
+      fen = argv[++i];
+    }else if((strcmp(argv[i], "--perft-batch") == 0)&&hasValue){
+      perftBatchFile = argv[++i];
+    }else if((strcmp(argv[i], "--depth") == 0)&&hasValue){
+      batchConfig.maxDepth = atoi(argv[++i]);
+    }else if((strcmp(argv[i], "--threads") == 0)&&hasValue){
+      batchConfig.threads = atoi(argv[++i]);
+    }else if((strcmp(argv[i], "--out") == 0)&&hasValue){
+      batchConfig.resultsFile = argv[++i];
+    }else if((strcmp(argv[i], "--mismatches") == 0)&&hasValue){
+      batchConfig.mismatchFile = argv[++i];
+    }else if((strcmp(argv[i], "--check-batch") == 0)&&hasValue){
+      checkBatchCount = atoi(argv[++i]);
+    }else if((strcmp(argv[i], "--check-incremental") == 0)&&hasValue){
+      checkIncrementalCount = atoi(argv[++i]);
+    }else if((strcmp(argv[i], "--write-random-net") == 0)&&hasValue){
+      randomNetFile = argv[++i];
+    }else if((strcmp(argv[i], "--check-nnue") == 0)&&hasValue){
+      checkNnueFile = argv[++i];
+    }else if((strcmp(argv[i], "--positions") == 0)&&hasValue){
+      nnuePositions = atoi(argv[++i]);
+    }else if((strcmp(argv[i], "--label") == 0)&&hasValue){
+      labelFile = argv[++i];
+#ifdef TRACK_ALLOCATIONS
+    }else if((strcmp(argv[i], "--forbid-allocations") == 0)&&hasValue){
+      if(!forbidAllocations(argv[++i])){
+	printf("unknown subsystem \"%s\"\n", argv[i]);
+	return 1;
+      }
+#endif
+    }else{
+      printBenchUsage();
+      return 1;
+    }
+  }
+  bool runMicro = (strcmp(suite, "micro") == 0)||(strcmp(suite, "all") == 0);
+  bool runPerft = (strcmp(suite, "perft") == 0)||(strcmp(suite, "all") == 0);
+  bool runSelf = (strcmp(suite, "selfplay") == 0)||(strcmp(suite, "all") == 0);
+  if(!(runMicro||runPerft||runSelf)){
+    printBenchUsage();
+    return 1;
+  }
+  if((config.samples < 2)||(config.perftSamples < 2)){
+    printf("need at least two samples\n");
+    return 1;
+  }
+
+  if(perftStatsDepth > 0){
+    generateDistanceToEdge();
+    boardState state;
+    if(!state.loadFromFen(fen)){
+      printf("bad fen \"%s\"\n", fen);
+      return 1;
+    }
+    if(divide){
+      nodeTestStats(perftStatsDepth, state);
+    }else{
+      perftStatsTable(perftStatsDepth, state);
+    }
+    return 0;
+  }
+
+  if(perftBatchFile != NULL){
+    generateDistanceToEdge();
+    return (runPerftBatch(perftBatchFile, &batchConfig) == 0) ? 0 : 1;
+  }
+
+  if(checkBatchCount > 0){
+    generateDistanceToEdge();
+    return (checkPositionBatch(checkBatchCount) == 0) ? 0 : 1;
+  }
+
+  if(checkIncrementalCount > 0){
+    generateDistanceToEdge();
+    return (checkIncrementalState(checkIncrementalCount) == 0) ? 0 : 1;
+  }
+
+  if(randomNetFile != NULL){
+    return nnueWriteRandomNetwork(randomNetFile, 0x9E3779B97F4A7C15ULL) ? 0 : 1;
+  }
+
+  if(checkNnueFile != NULL){
+    generateDistanceToEdge();
+    return (checkNnue(checkNnueFile, nnuePositions) == 0) ? 0 : 1;
+  }
+
+  if(labelFile != NULL){
+    generateDistanceToEdge();
+    return (labelPositionFile(labelFile) == 0) ? 0 : 1;
+  }
+
+  std::vector<benchResult> baseline;
+  if(compareFile != NULL){
+    baseline = readBaseline(compareFile);
+  }
+
+  generateDistanceToEdge();
+  std::vector<benchResult> results;
+  bool perftOk = true;
+  if(runPerft){
+    perftOk = runPerftSuite(&config, &results);
+  }
+  if(runSelf){
+    runSelfPlay(&config, &results);
+  }
+  if(runMicro){
+    std::vector<benchResult> microResults = runMicrobenchmarks(&config);
+    results.insert(results.end(), microResults.begin(), microResults.end());
+  }
+  if(!perftOk){
+    printf("perft node counts are wrong, not saving or comparing timings\n");
+    return 1;
+  }
+
+  if(saveBaselineFile != NULL){
+    writeBaseline(saveBaselineFile, &results);
+  }
+  if(compareFile != NULL){
+    int regressions = compareToBaseline(&baseline, &results, thresholdPercent, alpha);
+    if(regressions > 0){
+      printf("%d significant slowdown(s) over %.1f%% against \"%s\"\n", regressions, thresholdPercent, compareFile);
+      return 2;
+    }
+    printf("no significant slowdowns against \"%s\"\n", compareFile);
+  }
+  return 0;
+}
@@ -0,0 +1,797 @@
+#include <time.h>
+#include <fcntl.h>
+#include <math.h>
+
+#include <vector>
+#include <algorithm>
+
+const char* benchPositions[] = {
+  "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+  "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+  "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+  "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+  "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+  "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+};
+const int numBenchPositions = sizeof(benchPositions)/sizeof(benchPositions[0]);
+
+//stockfish output for "go depth 25" from the starting position, info lines only
+const char* recordedEngineOutput[] = {
+  "info string NNUE evaluation using nn-b1a57edbea57.nnue enabled",
+  "info depth 1 seldepth 1 multipv 1 score cp 18 nodes 20 nps 20000 hashfull 0 tbhits 0 time 1 pv e2e4",
+  "info depth 2 seldepth 2 multipv 1 score cp 46 nodes 66 nps 66000 hashfull 0 tbhits 0 time 1 pv d2d4",
+  "info depth 5 seldepth 5 multipv 1 score cp 39 nodes 491 nps 245500 hashfull 0 tbhits 0 time 2 pv e2e4 e7e5 g1f3",
+  "info depth 10 seldepth 13 multipv 1 score cp 35 nodes 11207 nps 800500 hashfull 4 tbhits 0 time 14 pv e2e4 e7e5 g1f3 b8c6 f1b5 g8f6 e1g1 f6e4 f1e1 e4d6",
+  "info depth 14 currmove d2d4 currmovenumber 2",
+  "info depth 16 seldepth 21 multipv 1 score cp 31 upperbound nodes 182733 nps 1217553 hashfull 61 tbhits 0 time 150 pv e2e4 c7c5",
+  "info depth 16 seldepth 22 multipv 1 score cp 38 lowerbound nodes 201517 nps 1233498 hashfull 66 tbhits 0 time 163 pv e2e4",
+  "info depth 20 seldepth 27 multipv 1 score cp 34 nodes 1893121 nps 1417903 hashfull 512 tbhits 0 time 1335 pv e2e4 e7e5 g1f3 b8c6 f1b5 a7a6 b5a4 g8f6 e1g1 f8e7 f1e1 b7b5 a4b3 d7d6 c2c3 e8g8 h2h3 c6a5 b3c2 c7c5",
+  "info depth 25 seldepth 33 multipv 1 score cp 29 nodes 14870125 nps 1503653 hashfull 997 tbhits 0 time 9889 pv e2e4 e7e5 g1f3 b8c6 f1b5 g8f6 e1g1 f6e4 f1e1 e4d6 f3e5 f8e7 b5f1 c6e5 e1e5 e8g8 d2d4 e7f6 e5e1 f8e8 c2c3 e8e1 d1e1 d6f5 c1f4",
+  "info depth 25 seldepth 9 multipv 1 score mate 5 nodes 40112 nps 1604480 hashfull 12 tbhits 0 time 25 pv d1h5 g7g6 h5e5 f8e7 e5h8 e8f7 h8h7 f7e6 h7g6",
+};
+const int numRecordedEngineOutput = sizeof(recordedEngineOutput)/sizeof(recordedEngineOutput[0]);
+
+volatile long long benchSink = 0;
+
+double
+nowNanoseconds(void){
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec*1e9) + ts.tv_nsec;
+}
+
+class benchWorkload {
+public:
+  std::vector<boardState> positions;
+  std::vector<std::vector<move>> legalMoves;
+  engine parser;
+  static const int lineBufferSize = 0x200;
+  std::vector<char> lineBuffers;
+  positionBatch batch;
+
+  benchWorkload(void){
+    for(int i = 0; i < numBenchPositions; i++){
+      boardState state;
+      if(!state.loadFromFen(benchPositions[i])){
+	printf("bad benchmark fen \"%s\"\n", benchPositions[i]);
+	exit(1);
+      }
+      positions.push_back(state);
+      legalMoves.push_back(chessGame::generateLegalMoves(&state));
+    }
+    lineBuffers.resize(numRecordedEngineOutput*lineBufferSize);
+    //every position 4 times so the avx2 pass never falls back to scalar for a leftover
+    for(int r = 0; r < 4; r++){
+      for(int i = 0; i < (int)positions.size(); i++){
+	batch.add(&positions[i]);
+      }
+    }
+  }
+};
+
+typedef long long (*benchPassFunction)(benchWorkload* w);
+
+long long
+benchPass_forceMove(benchWorkload* w){
+  long long ops = 0;
+  for(int i = 0; i < (int)w->positions.size(); i++){
+    for(int m = 0; m < (int)w->legalMoves[i].size(); m++){
+      boardState tmp = w->positions[i];
+      chessGame::forceMove(w->legalMoves[i][m], &tmp);
+      benchSink += tmp.board[w->legalMoves[i][m].to];
+      ops++;
+    }
+  }
+  return ops;
+}
+
+long long
+benchPass_generatePseudoLegalMoves(benchWorkload* w){
+  long long ops = 0;
+  for(int i = 0; i < (int)w->positions.size(); i++){
+    std::vector<move> moves = chessGame::generatePseudoLegalMoves(&w->positions[i]);
+    benchSink += moves.size();
+    ops++;
+  }
+  return ops;
+}
+
+long long
+benchPass_generateLegalMoves(benchWorkload* w){
+  long long ops = 0;
+  for(int i = 0; i < (int)w->positions.size(); i++){
+    std::vector<move> moves = chessGame::generateLegalMoves(&w->positions[i]);
+    benchSink += moves.size();
+    ops++;
+  }
+  return ops;
+}
+
+long long
+benchPass_isInCheck(benchWorkload* w){
+  long long ops = 0;
+  for(int i = 0; i < (int)w->positions.size(); i++){
+    benchSink += chessGame::isInCheck(&w->positions[i], w->positions[i].isWhitesTurn);
+    benchSink += chessGame::isInCheck(&w->positions[i], !w->positions[i].isWhitesTurn);
+    ops += 2;
+  }
+  return ops;
+}
+
+long long
+benchPass_positionBatchScalar(benchWorkload* w){
+  positionBatchScalar(&w->batch, 0, w->batch.size());
+  benchSink += w->batch.legalMoveCount[0];
+  return w->batch.size();
+}
+
+long long
+benchPass_positionBatchAvx2(benchWorkload* w){
+  positionBatchAvx2(&w->batch, 0, w->batch.size());
+  benchSink += w->batch.legalMoveCount[0];
+  return w->batch.size();
+}
+
+long long
+benchPass_convertBoardToFen(benchWorkload* w){
+  long long ops = 0;
+  for(int i = 0; i < (int)w->positions.size(); i++){
+    char* fen = w->positions[i].convertBoardToFen();
+    benchSink += fen[0];
+    free(fen);
+    ops++;
+  }
+  return ops;
+}
+
+long long
+benchPass_processInfoString(benchWorkload* w){
+  //processInfoString writes into the line it is given so every pass needs fresh copies
+  for(int i = 0; i < numRecordedEngineOutput; i++){
+    strcpy(&w->lineBuffers[i*benchWorkload::lineBufferSize], recordedEngineOutput[i]);
+  }
+  long long ops = 0;
+  for(int i = 0; i < numRecordedEngineOutput; i++){
+    w->parser.processInfoString(&w->lineBuffers[i*benchWorkload::lineBufferSize]);
+    benchSink += w->parser.info_depth;
+    ops++;
+  }
+  return ops;
+}
+
+class benchConfig {
+public:
+  int warmupSamples = 5;
+  int samples = 30;
+  int perftSamples = 7;
+  int selfPlayGames = 4;
+  double minSampleNanoseconds = 2e6;
+  const char* filter = NULL;
+};
+
+class benchResult {
+public:
+  char name[64];
+  const char* unit;
+  std::vector<double> values;
+  long long opsPerSample;
+  double mean;
+  double min;
+  double p50;
+  double p90;
+  double p99;
+  double max;
+};
+
+double
+percentile(std::vector<double>& sorted, double p){
+  int index = (int)(p*(sorted.size()-1) + 0.5);
+  return sorted[index];
+}
+
+void
+summarizeSamples(benchResult* result){
+  std::vector<double> sorted = result->values;
+  double total = 0;
+  for(int i = 0; i < (int)sorted.size(); i++){
+    total += sorted[i];
+  }
+  result->mean = total/sorted.size();
+  std::sort(sorted.begin(), sorted.end());
+  result->min = sorted.front();
+  result->p50 = percentile(sorted, 0.50);
+  result->p90 = percentile(sorted, 0.90);
+  result->p99 = percentile(sorted, 0.99);
+  result->max = sorted.back();
+}
+
+benchResult
+runMicrobenchmark(const char* name, benchPassFunction pass, benchWorkload* w, benchConfig* config){
+  //calibrate how many passes make a sample long enough for the clock to be meaningful
+  int passesPerSample = 1;
+  while(true){
+    double start = nowNanoseconds();
+    for(int i = 0; i < passesPerSample; i++){
+      pass(w);
+    }
+    double elapsed = nowNanoseconds()-start;
+    if((elapsed >= config->minSampleNanoseconds)||(passesPerSample >= (1<<20))){
+      break;
+    }
+    passesPerSample *= 2;
+  }
+
+  for(int s = 0; s < config->warmupSamples; s++){
+    for(int i = 0; i < passesPerSample; i++){
+      pass(w);
+    }
+  }
+
+  benchResult result;
+  snprintf(result.name, sizeof(result.name), "%s", name);
+  result.unit = "ns/op";
+  result.opsPerSample = 0;
+  for(int s = 0; s < config->samples; s++){
+    long long ops = 0;
+    double start = nowNanoseconds();
+    for(int i = 0; i < passesPerSample; i++){
+      ops += pass(w);
+    }
+    double elapsed = nowNanoseconds()-start;
+    result.values.push_back(elapsed/ops);
+    result.opsPerSample = ops;
+  }
+  summarizeSamples(&result);
+  return result;
+}
+
+void
+printBenchHeader(const char* unit){
+  char meanTitle[32];
+  snprintf(meanTitle, sizeof(meanTitle), "mean %s", unit);
+  printf("%-28s %14s %14s %14s %14s %14s %14s %8s\n", "benchmark", meanTitle, "min", "p50", "p90", "p99", "max", "samples");
+}
+
+void
+printBenchResult(benchResult* r){
+  printf("%-28s %14.1f %14.1f %14.1f %14.1f %14.1f %14.1f %8d\n", r->name, r->mean, r->min, r->p50, r->p90, r->p99, r->max, (int)r->values.size());
+}
+
+class microbenchmark {
+public:
+  const char* name;
+  benchPassFunction pass;
+  bool writesToStdout;
+};
+
+const microbenchmark microbenchmarks[] = {
+  {"forceMove", benchPass_forceMove, false},
+  {"generatePseudoLegalMoves", benchPass_generatePseudoLegalMoves, false},
+  {"generateLegalMoves", benchPass_generateLegalMoves, false},
+  {"isInCheck", benchPass_isInCheck, false},
+  {"positionBatch scalar", benchPass_positionBatchScalar, false},
+  {"positionBatch avx2", benchPass_positionBatchAvx2, false},
+  {"convertBoardToFen", benchPass_convertBoardToFen, false},
+  {"processInfoString", benchPass_processInfoString, true},
+};
+const int numMicrobenchmarks = sizeof(microbenchmarks)/sizeof(microbenchmarks[0]);
+
+std::vector<benchResult>
+runMicrobenchmarks(benchConfig* config){
+  benchWorkload workload;
+  std::vector<benchResult> results;
+  printBenchHeader("ns/op");
+  for(int i = 0; i < numMicrobenchmarks; i++){
+    const microbenchmark* b = &microbenchmarks[i];
+    if((config->filter != NULL)&&(strstr(b->name, config->filter) == NULL)){
+      continue;
+    }
+    //processInfoString dumps the parsed fields every call, keep that off the terminal but still pay for it
+    int savedStdout = -1;
+    if(b->writesToStdout){
+      fflush(stdout);
+      savedStdout = dup(fileno(stdout));
+      int devNull = open("/dev/null", O_WRONLY);
+      if((savedStdout < 0)||(devNull < 0)){
+	printf("failed to redirect stdout: %s\n", strerror(errno));
+	exit(1);
+      }
+      dup2(devNull, fileno(stdout));
+      close(devNull);
+    }
+    benchResult result = runMicrobenchmark(b->name, b->pass, &workload, config);
+    if(b->writesToStdout){
+      fflush(stdout);
+      dup2(savedStdout, fileno(stdout));
+      close(savedStdout);
+    }
+    printBenchResult(&result);
+    results.push_back(result);
+  }
+  return results;
+}
+
+//returns false if any node count differs from the reference numbers
+bool
+runPerftSuite(benchConfig* config, std::vector<benchResult>* results){
+  bool allMatch = true;
+  printBenchHeader("nodes/s");
+  for(int i = 0; i < numPerftSuite; i++){
+    const perftPosition* p = &perftSuite[i];
+    benchResult result;
+    snprintf(result.name, sizeof(result.name), "perft %s d%d", p->name, p->depth);
+    if((config->filter != NULL)&&(strstr(result.name, config->filter) == NULL)){
+      continue;
+    }
+    boardState state;
+    if(!state.loadFromFen(p->fen)){
+      printf("bad perft fen \"%s\"\n", p->fen);
+      exit(1);
+    }
+    result.unit = "nodes/s";
+    result.opsPerSample = p->expectedNodes;
+#ifdef PERF_COUNTERS
+    perfCountersReset();
+#endif
+#ifdef TRACK_ALLOCATIONS
+    allocSnapshot beforePerft = takeAllocSnapshot();
+#endif
+    for(int s = 0; s < config->perftSamples; s++){
+      double start = nowNanoseconds();
+      long long nodes;
+      {
+	PERF_REGION(perfRegion_perft);
+	nodes = nodeTree(p->depth, state);
+      }
+      double elapsed = nowNanoseconds()-start;
+      if(nodes != p->expectedNodes){
+	printf("PERFT MISMATCH %s: got %lld expected %d\n", result.name, nodes, p->expectedNodes);
+	allMatch = false;
+	break;
+      }
+      result.values.push_back(nodes/(elapsed*1e-9));
+    }
+    if(result.values.empty()){
+      continue;
+    }
+    summarizeSamples(&result);
+    printBenchResult(&result);
+#ifdef PERF_COUNTERS
+    perfCountersReport((long long)p->expectedNodes*result.values.size());
+#endif
+#ifdef TRACK_ALLOCATIONS
+    printAllocationsSince(&beforePerft, (long long)p->expectedNodes*result.values.size(), "node");
+#endif
+    results->push_back(result);
+  }
+  return allMatch;
+}
+
+void
+writeBaseline(const char* filename, std::vector<benchResult>* results){
+  FILE* f = fopen(filename, "w");
+  if(f == NULL){
+    printf("failed to open baseline \"%s\": %s\n", filename, strerror(errno));
+    exit(1);
+  }
+  fprintf(f, "{\n  \"version\": 1,\n  \"results\": [\n");
+  for(int i = 0; i < (int)results->size(); i++){
+    benchResult* r = &(*results)[i];
+    fprintf(f, "    {\"name\": \"%s\", \"unit\": \"%s\", \"p50\": %.3f, \"samples\": [", r->name, r->unit, r->p50);
+    for(int s = 0; s < (int)r->values.size(); s++){
+      fprintf(f, "%s%.3f", (s == 0) ? "" : ", ", r->values[s]);
+    }
+    fprintf(f, "]}%s\n", (i+1 < (int)results->size()) ? "," : "");
+  }
+  fprintf(f, "  ]\n}\n");
+  fclose(f);
+  printf("wrote %d results to \"%s\"\n", (int)results->size(), filename);
+}
+
+//only understands the layout writeBaseline produces
+std::vector<benchResult>
+readBaseline(const char* filename){
+  FILE* f = fopen(filename, "rb");
+  if(f == NULL){
+    printf("failed to open baseline \"%s\": %s\n", filename, strerror(errno));
+    exit(1);
+  }
+  fseek(f, 0, SEEK_END);
+  int length = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  std::vector<char> text(length+1);
+  if((int)fread(text.data(), 1, length, f) != length){
+    printf("failed to read baseline \"%s\"\n", filename);
+    exit(1);
+  }
+  text[length] = '\0';
+  fclose(f);
+
+  std::vector<benchResult> results;
+  char* p = text.data();
+  while((p = strstr(p, "\"name\": \"")) != NULL){
+    benchResult r;
+    p += sizeof("\"name\": \"")-1;
+    char* end = strchr(p, '"');
+    if(end == NULL){
+      break;
+    }
+    snprintf(r.name, sizeof(r.name), "%.*s", (int)(end-p), p);
+    p = end;
+    r.unit = "ns/op";
+    char* unit = strstr(p, "\"unit\": \"nodes/s\"");
+    char* nextEntry = strstr(p, "\"name\": \"");
+    if((unit != NULL)&&((nextEntry == NULL)||(unit < nextEntry))){
+      r.unit = "nodes/s";
+    }
+    char* samples = strstr(p, "\"samples\": [");
+    if(samples == NULL){
+      printf("baseline entry \"%s\" has no samples\n", r.name);
+      exit(1);
+    }
+    p = samples + sizeof("\"samples\": [")-1;
+    while(*p != ']'){
+      char* numberEnd;
+      double value = strtod(p, &numberEnd);
+      if(numberEnd == p){
+	printf("bad sample in baseline entry \"%s\"\n", r.name);
+	exit(1);
+      }
+      r.values.push_back(value);
+      p = numberEnd;
+      while((*p == ',')||(*p == ' ')){
+	p++;
+      }
+    }
+    summarizeSamples(&r);
+    results.push_back(r);
+  }
+  return results;
+}
+
+//one sided mann-whitney u test, small p means current samples are larger than baseline samples
+double
+mannWhitneyPValue(std::vector<double>& baseline, std::vector<double>& current){
+  int n1 = baseline.size();
+  int n2 = current.size();
+  double u = 0;
+  for(int i = 0; i < n1; i++){
+    for(int j = 0; j < n2; j++){
+      if(current[j] > baseline[i]){
+	u += 1;
+      }else if(current[j] == baseline[i]){
+	u += 0.5;
+      }
+    }
+  }
+  double meanU = n1*n2/2.0;
+  double sigmaU = sqrt(n1*n2*(n1+n2+1)/12.0);
+  if(sigmaU == 0){
+    return 1;
+  }
+  double z = (u-meanU-0.5)/sigmaU;
+  return 0.5*erfc(z/sqrt(2.0));
+}
+
+//nodes/s goes up when things get faster, turn everything into "bigger is slower" before comparing
+std::vector<double>
+costSamples(benchResult* r){
+  std::vector<double> cost;
+  for(int i = 0; i < (int)r->values.size(); i++){
+    if(strcmp(r->unit, "nodes/s") == 0){
+      cost.push_back(1e9/r->values[i]);
+    }else{
+      cost.push_back(r->values[i]);
+    }
+  }
+  return cost;
+}
+
+//returns the number of significant slowdowns
+int
+compareToBaseline(std::vector<benchResult>* baseline, std::vector<benchResult>* current, double thresholdPercent, double alpha){
+  int regressions = 0;
+  printf("%-28s %8s %14s %14s %9s %9s  %s\n", "benchmark", "unit", "baseline p50", "current p50", "slowdown", "p-value", "status");
+  for(int i = 0; i < (int)current->size(); i++){
+    benchResult* c = &(*current)[i];
+    benchResult* b = NULL;
+    for(int j = 0; j < (int)baseline->size(); j++){
+      if(strcmp((*baseline)[j].name, c->name) == 0){
+	b = &(*baseline)[j];
+	break;
+      }
+    }
+    if(b == NULL){
+      printf("%-28s %8s %14s %14.1f %9s %9s  %s\n", c->name, c->unit, "-", c->p50, "-", "-", "new");
+      continue;
+    }
+    std::vector<double> baseCost = costSamples(b);
+    std::vector<double> currentCost = costSamples(c);
+    std::vector<double> sortedBase = baseCost;
+    std::vector<double> sortedCurrent = currentCost;
+    std::sort(sortedBase.begin(), sortedBase.end());
+    std::sort(sortedCurrent.begin(), sortedCurrent.end());
+    double slowdownPercent = 100.0*((percentile(sortedCurrent, 0.5)/percentile(sortedBase, 0.5))-1.0);
+    double p = mannWhitneyPValue(baseCost, currentCost);
+    const char* status = "ok";
+    if((slowdownPercent > thresholdPercent)&&(p < alpha)){
+      status = "REGRESSION";
+      regressions++;
+    }else if((slowdownPercent < -thresholdPercent)&&(mannWhitneyPValue(currentCost, baseCost) < alpha)){
+      status = "faster";
+    }
+    printf("%-28s %8s %14.1f %14.1f %8.1f%% %9.4f  %s\n", c->name, c->unit, b->p50, c->p50, slowdownPercent, p, status);
+  }
+  return regressions;
+}
+
+class selfPlayStats {
+public:
+  int games = 0;
+  long long moves = 0;
+  int checkmates = 0;
+  int stalemates = 0;
+  int fiftyMoveDraws = 0;
+  int insufficientMaterialDraws = 0;
+  int tooLong = 0;
+};
+
+unsigned long long
+nextRandom(unsigned long long* rngState){
+  unsigned long long x = *rngState;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  *rngState = x;
+  return x;
+}
+
+//positions along random games from the start, through forceMove, the last position of a game included before the next starts
+//always the same seed, so every run of a check sees the same positions
+void
+randomGamePositions(int count, std::vector<boardState>* out){
+  unsigned long long rngState = 0x9E3779B97F4A7C15ULL;
+  out->clear();
+  while((int)out->size() < count){
+    boardState state;
+    while((int)out->size() < count){
+      std::vector<move> legalMoves = chessGame::generateLegalMoves(&state);
+      out->push_back(state);
+      if((legalMoves.size() == 0)||(state.halfMoves > fifty_move_rule_max)){
+	break;
+      }
+      chessGame::forceMove(legalMoves[nextRandom(&rngState)%legalMoves.size()], &state);
+    }
+  }
+}
+
+//engine free game with random legal moves, goes through the same calls runGame and handleWinConditions make
+long long
+playRandomGame(unsigned long long* rngState, selfPlayStats* stats){
+  chessGame game;
+  long long moves = 0;
+  while(true){
+    std::vector<move> legalMoves = chessGame::generateLegalMoves(&game.currentState);
+    if(legalMoves.size() == 0){
+      if(chessGame::isInCheck(&game.currentState, game.currentState.isWhitesTurn)){
+	stats->checkmates++;
+      }else{
+	stats->stalemates++;
+      }
+      break;
+    }
+    if(game.currentState.isInsufficientMaterial()){
+      stats->insufficientMaterialDraws++;
+      break;
+    }
+    if(game.currentState.halfMoves > fifty_move_rule_max){
+      stats->fiftyMoveDraws++;
+      break;
+    }
+    if(game.currentBackup+1 >= chessGame::maxBackup){
+      stats->tooLong++;
+      break;
+    }
+    move chosen = legalMoves[nextRandom(rngState)%legalMoves.size()];
+    if(!game.attemptMove(chosen)){
+      printf("self-play legal move was rejected by attemptMove\n");
+      exit(1);
+    }
+    char* fen = game.currentState.convertBoardToFen();
+    benchSink += fen[0];
+    free(fen);
+    moves++;
+  }
+  stats->games++;
+  stats->moves += moves;
+  return moves;
+}
+
+void
+runSelfPlay(benchConfig* config, std::vector<benchResult>* results){
+  benchResult result;
+  snprintf(result.name, sizeof(result.name), "selfplay %d games", config->selfPlayGames);
+  if((config->filter != NULL)&&(strstr(result.name, config->filter) == NULL)){
+    return;
+  }
+  result.unit = "ns/op";
+  result.opsPerSample = 0;
+  selfPlayStats stats;
+  for(int s = 0; s < config->perftSamples; s++){
+    unsigned long long rngState = 0x9E3779B97F4A7C15ULL;//same games every sample so samples are comparable
+    long long moves = 0;
+    double start = nowNanoseconds();
+    for(int i = 0; i < config->selfPlayGames; i++){
+      moves += playRandomGame(&rngState, &stats);
+    }
+    double elapsed = nowNanoseconds()-start;
+    result.values.push_back(elapsed/moves);
+    result.opsPerSample = moves;
+  }
+  summarizeSamples(&result);
+  printBenchHeader("ns/move");
+  printBenchResult(&result);
+  printf("%d games, %lld moves: %d checkmates, %d stalemates, %d insufficient material, %d fifty move draws, %d too long\n",
+	 stats.games, stats.moves, stats.checkmates, stats.stalemates, stats.insufficientMaterialDraws, stats.fiftyMoveDraws, stats.tooLong);
+  results->push_back(result);
+}
+
+//random games through forceMove, the key and eval sums it keeps up to date checked against a recompute after every move
+long long
+checkIncrementalState(int count){
+  std::vector<boardState> states;
+  randomGamePositions(count, &states);
+  long long mismatches = 0;
+  for(int i = 0; i < count; i++){
+    boardState* state = &states[i];
+    if(state->incrementalMatches()){
+      continue;
+    }
+    if(mismatches < 10){
+      char* fen = state->convertBoardToFen();
+      int mg, eg, phase;
+      state->computeEval(&mg, &eg, &phase);
+      printf("incremental state off on \"%s\": key %016llx pawn key %016llx mg %d eg %d phase %d, recomputed key %016llx pawn key %016llx mg %d eg %d phase %d\n", fen,
+	     state->key, state->pawnKey, state->mgScore, state->egScore, state->gamePhase, state->computeKey(), state->computePawnKey(), mg, eg, phase);
+      free(fen);
+    }
+    mismatches++;
+  }
+  printf("%d positions, %lld mismatches\n", count, mismatches);
+  return mismatches;
+}
+
+//pairs of positions a random move apart, each child's accumulator updated from its parent's with every simd level
+//checked against a full scalar refresh, the evals against the scalar one, and both timed
+long long
+checkNnue(const char* path, int count){
+  nnueNetwork net;
+  if(!net.load(path)){
+    return 1;
+  }
+  std::vector<boardState> positions;
+  randomGamePositions(count, &positions);
+  //every position that has a move is a parent, one random move from it the child
+  unsigned long long rngState = 0x9E3779B97F4A7C15ULL;
+  std::vector<boardState> parents;
+  std::vector<boardState> children;
+  for(int i = 0; i < count; i++){
+    std::vector<move> legalMoves = chessGame::generateLegalMoves(&positions[i]);
+    if(legalMoves.size() == 0){
+      continue;
+    }
+    parents.push_back(positions[i]);
+    boardState child = positions[i];
+    chessGame::forceMove(legalMoves[nextRandom(&rngState)%legalMoves.size()], &child);
+    children.push_back(child);
+  }
+  count = parents.size();
+
+  int bestLevel = nnueSimdLevel;
+  nnueSimdLevel = nnueSimd_scalar;
+  std::vector<nnueAccumulator> parentAccs(count);
+  std::vector<nnueAccumulator> expectedAccs(count);
+  std::vector<int> expectedEvals(count);
+  double start = nowNanoseconds();
+  for(int i = 0; i < count; i++){
+    nnueRefreshBoth(&net, &children[i], &expectedAccs[i]);
+  }
+  double refreshTime = nowNanoseconds()-start;
+  for(int i = 0; i < count; i++){
+    nnueRefreshBoth(&net, &parents[i], &parentAccs[i]);
+    expectedEvals[i] = nnueEvaluate(&net, &expectedAccs[i], children[i].isWhitesTurn);
+  }
+
+  long long mismatches = 0;
+  printf("%d positions, network \"%s\"\n", count, path);
+  printf("%-34s %14s %10s %10s\n", "", "ns/update", "ns/eval", "mismatches");
+  printf("%-34s %14.1f %10s %10s\n", "scalar full refresh", refreshTime/count, "", "");
+  std::vector<nnueAccumulator> childAccs(count);
+  std::vector<int> evals(count);
+  for(int level = nnueSimd_scalar; level <= bestLevel; level++){
+    nnueSimdLevel = level;
+    start = nowNanoseconds();
+    for(int i = 0; i < count; i++){
+      nnueUpdate(&net, &parents[i], &parentAccs[i], &children[i], &childAccs[i]);
+    }
+    double updateTime = nowNanoseconds()-start;
+    start = nowNanoseconds();
+    for(int i = 0; i < count; i++){
+      evals[i] = nnueEvaluate(&net, &childAccs[i], children[i].isWhitesTurn);
+    }
+    double evalTime = nowNanoseconds()-start;
+    long long levelMismatches = 0;
+    for(int i = 0; i < count; i++){
+      if((memcmp(childAccs[i].values, expectedAccs[i].values, sizeof(expectedAccs[i].values)) == 0)&&(evals[i] == expectedEvals[i])){
+	continue;
+      }
+      if(levelMismatches < 5){
+	char* fen = children[i].convertBoardToFen();
+	printf("%s disagrees on \"%s\": eval %d, expected %d\n", nnueSimdNames[level], fen, evals[i], expectedEvals[i]);
+	free(fen);
+      }
+      levelMismatches++;
+    }
+    printf("%-34s %14.1f %10.1f %10lld\n", nnueSimdNames[level], updateTime/count, evalTime/count, levelMismatches);
+    mismatches += levelMismatches;
+  }
+  nnueSimdLevel = bestLevel;
+  return mismatches;
+}
+
+//positions from random games, checked batch against generateLegalMoves/isInCheck, returns the number that disagree
+long long
+checkPositionBatch(int count){
+  std::vector<boardState> states;
+  randomGamePositions(count, &states);
+
+  std::vector<int> expectedCounts(count);
+  std::vector<bool> expectedChecks(count);
+  double start = nowNanoseconds();
+  for(int i = 0; i < count; i++){
+    expectedCounts[i] = chessGame::generateLegalMoves(&states[i]).size();
+    expectedChecks[i] = chessGame::isInCheck(&states[i], states[i].isWhitesTurn);
+  }
+  double oneAtATime = nowNanoseconds()-start;
+
+  positionBatch scalar;
+  for(int i = 0; i < count; i++){
+    scalar.add(&states[i]);
+  }
+  positionBatch avx2 = scalar;
+  start = nowNanoseconds();
+  positionBatchScalar(&scalar, 0, count);
+  double scalarTime = nowNanoseconds()-start;
+  start = nowNanoseconds();
+  positionBatchAvx2(&avx2, 0, count);
+  double avx2Time = nowNanoseconds()-start;
+
+  long long mismatches = 0;
+  int statusCounts[numGameStatuses] = {0};
+  for(int i = 0; i < count; i++){
+    statusCounts[scalar.status[i]]++;
+    positionBatch* batches[2] = {&scalar, &avx2};
+    for(int b = 0; b < 2; b++){
+      if((batches[b]->legalMoveCount[i] == expectedCounts[i])&&(batches[b]->inCheck[i] == expectedChecks[i])&&(batches[b]->status[i] == scalar.status[i])){
+	continue;
+      }
+      if(mismatches < 10){
+	char* fen = states[i].convertBoardToFen();
+	printf("%s kernel disagrees on \"%s\": %d moves%s, expected %d moves%s\n", (b == 0) ? "scalar" : "avx2", fen,
+	       batches[b]->legalMoveCount[i], batches[b]->inCheck[i] ? " in check" : "", expectedCounts[i], expectedChecks[i] ? " in check" : "");
+	free(fen);
+      }
+      mismatches++;
+    }
+  }
+  printf("%d positions:", count);
+  for(int s = 0; s < numGameStatuses; s++){
+    printf(" %d %s%s", statusCounts[s], gameStatusNames[s], (s+1 < numGameStatuses) ? "," : "\n");
+  }
+  printf("%-34s %14s %10s\n", "", "positions/s", "ns/pos");
+  printf("%-34s %14.0f %10.1f\n", "generateLegalMoves + isInCheck", count/(oneAtATime*1e-9), oneAtATime/count);
+  printf("%-34s %14.0f %10.1f\n", "positionBatch scalar", count/(scalarTime*1e-9), scalarTime/count);
+  printf("%-34s %14.0f %10.1f%s\n", "positionBatch avx2", count/(avx2Time*1e-9), avx2Time/count, positionBatchHasAvx2() ? "" : " (no avx2 on this cpu, ran scalar)");
+  printf("%lld mismatches\n", mismatches);
+  return mismatches;
+}
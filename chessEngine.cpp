@@ -1,5 +1,6 @@
 bool
 waitForData(int fd, int timeoutMilliseconds){
+  TRACE_SPAN("waitForData");
   pollfd thingy;
   thingy.fd = fd;
   thingy.events = POLLIN;
@@ -122,6 +123,16 @@ public:
   static const int maxCurrlineMoves = 0xff;
   int numCurrlineMoves;
   char info_currline[maxCurrlineMoves][5];
+
+  int searchDepth = 25;
+  gameClock* clock = NULL;//searches to searchDepth while this is NULL or not running
+  bool handshakeDone = false;
+  bool verbose = true;//dump every info line and the bestmove, off for batch jobs
+
+  //info gets reset once bestmove arrives, the last depth/score of the search is kept here
+  int bestmove_depth = 0;
+  int bestmove_score = 0;
+  bool bestmove_score_mate = false;
   
   void
   resetEngineData(void){
@@ -213,7 +224,11 @@ public:
 
   void
   processInfoString(char* infoString){
-    printEngineData();
+    TRACE_SPAN("processInfoString");
+    ALLOC_SUBSYSTEM(allocSubsystem_uci);
+    if(verbose){
+      printEngineData();
+    }
     char* splitString;
     
     if((splitString = strstr(infoString, "string ")) != NULL){
@@ -225,7 +240,7 @@ public:
     if((splitString = strstr(infoString, "depth ")) != NULL){
       splitString += sizeof("depth ")-1;
       if(sscanf(splitString, "%d", &info_depth) != 1){
-      	printf("no number after depth\n");
+	printf("no number after depth\n");
 	exit(1);
       }
     }
@@ -352,10 +367,13 @@ public:
       numCurrlineMoves = readStringOfMovesIntoBuffer(splitString, currlineBuffer, maxCurrlineMoves);
       memcpy(info_currline, currlineBuffer, sizeof(currlineBuffer));
     }
+    TRACE_COUNTER("engine depth", info_depth);
+    TRACE_COUNTER("engine nodes", info_nodes);
   }
 
   void
   waitForString(const char* getString){
+    ALLOC_SUBSYSTEM(allocSubsystem_uci);
     char buffer[0xffff];
     int timeoutmilliseconds = 120000;
     while(true){
@@ -389,6 +407,9 @@ public:
   move
   getBestMove(boardState* state)
   {
+    TRACE_SPAN("engine::getBestMove");
+    ALLOC_SUBSYSTEM(allocSubsystem_uci);
+    finishHandshake();
     resetEngineData();
     char writeCmd[0xff];
     sprintf(writeCmd, "isready\n");
@@ -399,10 +420,22 @@ public:
     sprintf(writeCmd, "position fen %s\n", fen);
     free(fen);
     writeToEngine(writeCmd);
-    sprintf(writeCmd, "go depth %d\n", 25);
+    int timeoutmilliseconds = 120000;
+    if((clock != NULL)&&clock->running){
+      int length = sprintf(writeCmd, "go wtime %lld btime %lld winc %lld binc %lld", clock->remainingMs[0], clock->remainingMs[1], clock->incrementMs, clock->incrementMs);
+      int movesToGo = clock->movesToGo(state->isWhitesTurn);
+      if(movesToGo > 0){
+	length += sprintf(writeCmd+length, " movestogo %d", movesToGo);
+      }
+      sprintf(writeCmd+length, "\n");
+      //the engine keeps to its own clock, anything well past it means it's stuck
+      timeoutmilliseconds = clock->remainingMs[state->isWhitesTurn ? 0 : 1] + 10000;
+    }else{
+      sprintf(writeCmd, "go depth %d\n", searchDepth);
+    }
     writeToEngine(writeCmd);
+    PERF_REGION(perfRegion_engineRead);
     char buffer[0xffff];
-    int timeoutmilliseconds = 120000;
     while(true){
       int isDataTimeout = waitForData(enginePipeFDRead, timeoutmilliseconds);
       if(!isDataTimeout){
@@ -449,7 +482,9 @@ public:
       if((bestmoveString = strstr(checkPos,  "bestmove ")) != NULL){
 	bestmoveString += sizeof("bestmove ")-1;
 	readMoveIntoBuffer(bestmoveString, bestmove);
-	printf("bestmove \"%c%c%c%c%c\" ", bestmove[0], bestmove[1], bestmove[2], bestmove[3], bestmove[4]);
+	if(verbose){
+	  printf("bestmove \"%c%c%c%c%c\" ", bestmove[0], bestmove[1], bestmove[2], bestmove[3], bestmove[4]);
+	}
 	int fromX = bestmove[0]-'a';
 	int fromY = 7 - (bestmove[1]-'1');
 	int toX = bestmove[2]-'a';
@@ -466,19 +501,33 @@ public:
 	  ponderString += sizeof("ponder ")-1;
 	  bestmoveHasPonder = true;
 	  readMoveIntoBuffer(ponderString, bestmove_ponder);
-	  printf("ponder \"%c%c%c%c%c\"", bestmove_ponder[0], bestmove_ponder[1], bestmove_ponder[2], bestmove_ponder[3], bestmove_ponder[4]);
+	  if(verbose){
+	    printf("ponder \"%c%c%c%c%c\"", bestmove_ponder[0], bestmove_ponder[1], bestmove_ponder[2], bestmove_ponder[3], bestmove_ponder[4]);
+	  }
 	}else{
 	  bestmoveHasPonder = false;
 	}
 	
-	printf("\n");
+	if(verbose){
+	  printf("\n");
+	}
+	bestmove_depth = info_depth;
+	bestmove_score = info_score;
+	bestmove_score_mate = info_score_mate;
 	resetEngineData();
 	return output;
       }
     }
   }
   
+  engine(void){//no process attached, only for parsing recorded engine output
+    resetEngineData();
+    enginePipeFDRead = -1;
+    enginePipeFDWrite = -1;
+  }
+
   engine(const char* filepath){
+    ALLOC_SUBSYSTEM(allocSubsystem_uci);
     resetEngineData();
     
     int pipeFdRead[2];
@@ -513,11 +562,24 @@ public:
     enginePipeFDRead = pipeFdRead[0];//output of read pipe;
     enginePipeFDWrite = pipeFdWrite[1];//input of write pipe
 
+    //the engine answers uciok in its own time, finishHandshake picks it up the first time it is needed
     char writeBuf[0xff];
     sprintf(writeBuf, "uci\n");
     writeToEngine(writeBuf);
+  }
+
+  void
+  finishHandshake(void){
+    if(handshakeDone){
+      return;
+    }
+    TRACE_SPAN("engine::finishHandshake");
+    ALLOC_SUBSYSTEM(allocSubsystem_uci);
     waitForString("uciok");
+    char writeBuf[0xff];
     sprintf(writeBuf, "setoption name Threads value 16\n");
     writeToEngine(writeBuf);
+    handshakeDone = true;
+    startupMark(startupMilestone_engineReady);
   }
 };
@@ -35,6 +35,8 @@ const UInt8 startingBoard[64] = {
 
 const int BoxSize = 150;
 
+const int fifty_move_rule_max = 50;
+
 const int dirLeft = -1;
 const int dirRight = 1;
 const int dirUp = -8;
@@ -57,6 +59,12 @@ public:
   int from;
   int to;
   char promotion;
+
+  move(void){
+    from = -1;
+    to = -1;
+    promotion = '\0';
+  }
   
   move(int from_, int to_){
     from = from_;
@@ -66,6 +74,221 @@ public:
 };
 
 
+//random numbers xor'd together into a position key, one per piece on square, castling rights, en passant file and side to move
+class zobristKeys
+{
+public:
+  unsigned long long pieces[12][64];
+  unsigned long long castling[16];//indexed by castlingRights(), already combined
+  unsigned long long enPassantFile[8];
+  unsigned long long blackToMove;
+  signed char pieceIndex[128];
+
+  zobristKeys(void){
+    unsigned long long seed = 0x9E3779B97F4A7C15ULL;
+    for(int p = 0; p < 12; p++){
+      for(int i = 0; i < 64; i++){
+	pieces[p][i] = nextRandom(&seed);
+      }
+    }
+    unsigned long long rights[4];
+    for(int i = 0; i < 4; i++){
+      rights[i] = nextRandom(&seed);
+    }
+    for(int mask = 0; mask < 16; mask++){
+      castling[mask] = 0;
+      for(int i = 0; i < 4; i++){
+	if(mask & (1 << i)){
+	  castling[mask] ^= rights[i];
+	}
+      }
+    }
+    for(int i = 0; i < 8; i++){
+      enPassantFile[i] = nextRandom(&seed);
+    }
+    blackToMove = nextRandom(&seed);
+    memset(pieceIndex, -1, sizeof(pieceIndex));
+    const char* pieceChars = "PNBRQKpnbrqk";
+    for(int p = 0; p < 12; p++){
+      pieceIndex[(int)pieceChars[p]] = p;
+    }
+  }
+
+  //splitmix64, fixed seed so keys are the same every run
+  static unsigned long long
+  nextRandom(unsigned long long* state){
+    unsigned long long z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+
+  unsigned long long
+  piece(UInt8 piece, int pos){
+    return pieces[(int)pieceIndex[piece]][pos];
+  }
+};
+
+zobristKeys zobrist;
+
+//piece square tables, from white's side with a8 first like board[], black reads them mirrored (pos^56)
+//middlegame and endgame values get blended by how much non-pawn material is left
+const int pstPawnMg[64] = {
+    0,   0,   0,   0,   0,   0,   0,   0,
+   50,  50,  50,  50,  50,  50,  50,  50,
+   10,  10,  20,  30,  30,  20,  10,  10,
+    5,   5,  10,  25,  25,  10,   5,   5,
+    0,   0,   0,  20,  20,   0,   0,   0,
+    5,  -5, -10,   0,   0, -10,  -5,   5,
+    5,  10,  10, -20, -20,  10,  10,   5,
+    0,   0,   0,   0,   0,   0,   0,   0
+};
+const int pstPawnEg[64] = {
+    0,   0,   0,   0,   0,   0,   0,   0,
+   80,  80,  80,  80,  80,  80,  80,  80,
+   50,  50,  50,  50,  50,  50,  50,  50,
+   30,  30,  30,  30,  30,  30,  30,  30,
+   15,  15,  15,  15,  15,  15,  15,  15,
+    5,   5,   5,   5,   5,   5,   5,   5,
+    0,   0,   0,   0,   0,   0,   0,   0,
+    0,   0,   0,   0,   0,   0,   0,   0
+};
+const int pstKnight[64] = {
+  -50, -40, -30, -30, -30, -30, -40, -50,
+  -40, -20,   0,   0,   0,   0, -20, -40,
+  -30,   0,  10,  15,  15,  10,   0, -30,
+  -30,   5,  15,  20,  20,  15,   5, -30,
+  -30,   0,  15,  20,  20,  15,   0, -30,
+  -30,   5,  10,  15,  15,  10,   5, -30,
+  -40, -20,   0,   5,   5,   0, -20, -40,
+  -50, -40, -30, -30, -30, -30, -40, -50
+};
+const int pstBishop[64] = {
+  -20, -10, -10, -10, -10, -10, -10, -20,
+  -10,   0,   0,   0,   0,   0,   0, -10,
+  -10,   0,   5,  10,  10,   5,   0, -10,
+  -10,   5,   5,  10,  10,   5,   5, -10,
+  -10,   0,  10,  10,  10,  10,   0, -10,
+  -10,  10,  10,  10,  10,  10,  10, -10,
+  -10,   5,   0,   0,   0,   0,   5, -10,
+  -20, -10, -10, -10, -10, -10, -10, -20
+};
+const int pstRook[64] = {
+    0,   0,   0,   0,   0,   0,   0,   0,
+    5,  10,  10,  10,  10,  10,  10,   5,
+   -5,   0,   0,   0,   0,   0,   0,  -5,
+   -5,   0,   0,   0,   0,   0,   0,  -5,
+   -5,   0,   0,   0,   0,   0,   0,  -5,
+   -5,   0,   0,   0,   0,   0,   0,  -5,
+   -5,   0,   0,   0,   0,   0,   0,  -5,
+    0,   0,   0,   5,   5,   0,   0,   0
+};
+const int pstQueen[64] = {
+  -20, -10, -10,  -5,  -5, -10, -10, -20,
+  -10,   0,   0,   0,   0,   0,   0, -10,
+  -10,   0,   5,   5,   5,   5,   0, -10,
+   -5,   0,   5,   5,   5,   5,   0,  -5,
+    0,   0,   5,   5,   5,   5,   0,  -5,
+  -10,   5,   5,   5,   5,   5,   0, -10,
+  -10,   0,   5,   0,   0,   0,   0, -10,
+  -20, -10, -10,  -5,  -5, -10, -10, -20
+};
+const int pstKingMg[64] = {
+  -30, -40, -40, -50, -50, -40, -40, -30,
+  -30, -40, -40, -50, -50, -40, -40, -30,
+  -30, -40, -40, -50, -50, -40, -40, -30,
+  -30, -40, -40, -50, -50, -40, -40, -30,
+  -20, -30, -30, -40, -40, -30, -30, -20,
+  -10, -20, -20, -20, -20, -20, -20, -10,
+   20,  20,   0,   0,   0,   0,  20,  20,
+   20,  30,  10,   0,   0,  10,  30,  20
+};
+const int pstKingEg[64] = {
+  -50, -40, -30, -20, -20, -30, -40, -50,
+  -30, -20, -10,   0,   0, -10, -20, -30,
+  -30, -10,  20,  30,  30,  20, -10, -30,
+  -30, -10,  30,  40,  40,  30, -10, -30,
+  -30, -10,  30,  40,  40,  30, -10, -30,
+  -30, -10,  20,  30,  30,  20, -10, -30,
+  -30, -30,   0,   0,   0,   0, -30, -30,
+  -50, -30, -30, -30, -30, -30, -30, -50
+};
+
+//knight 1, bishop 1, rook 2, queen 4, all of them on the board is 24
+const int maxGamePhase = 24;
+
+//material + table per piece and square, already negated for black, what setSquare adds and removes
+class pieceSquareTables
+{
+public:
+  int mg[128][64];
+  int eg[128][64];
+  int phase[128];
+
+  pieceSquareTables(void){
+    memset(mg, 0, sizeof(mg));
+    memset(eg, 0, sizeof(eg));
+    memset(phase, 0, sizeof(phase));
+    fill(WP, 82, 94, pstPawnMg, pstPawnEg, 0);
+    fill(WN, 337, 281, pstKnight, pstKnight, 1);
+    fill(WB, 365, 297, pstBishop, pstBishop, 1);
+    fill(WR, 477, 512, pstRook, pstRook, 2);
+    fill(WQ, 1025, 936, pstQueen, pstQueen, 4);
+    fill(WK, 0, 0, pstKingMg, pstKingEg, 0);
+  }
+
+  void
+  fill(UInt8 whitePiece, int mgValue, int egValue, const int* mgTable, const int* egTable, int phaseWeight){
+    UInt8 blackPiece = tolower(whitePiece);
+    for(int i = 0; i < 64; i++){
+      mg[whitePiece][i] = mgValue + mgTable[i];
+      eg[whitePiece][i] = egValue + egTable[i];
+      mg[blackPiece][i] = -(mgValue + mgTable[i^56]);
+      eg[blackPiece][i] = -(egValue + egTable[i^56]);
+    }
+    phase[whitePiece] = phaseWeight;
+    phase[blackPiece] = phaseWeight;
+  }
+};
+
+pieceSquareTables pst;
+
+//material signature, how many of each piece type each side has, 4 bits a type, kings left out
+//white P N B R Q in bits 0-19, black in 20-39, setSquare adds and subtracts so it's always exact
+const int materialBits = 4;
+const unsigned long long materialWhiteMask = 0xFFFFFULL;
+const unsigned long long materialBlackMask = 0xFFFFFULL << 20;
+//knights, bishops, rooks and queens, everything but pawns
+const unsigned long long materialWhitePiecesMask = 0xFFFF0ULL;
+const unsigned long long materialBlackPiecesMask = 0xFFFF0ULL << 20;
+
+class materialSignatures
+{
+public:
+  unsigned long long weight[128];
+  int shift[128];
+
+  materialSignatures(void){
+    memset(weight, 0, sizeof(weight));
+    memset(shift, 0, sizeof(shift));
+    const char order[11] = "PNBRQpnbrq";
+    for(int i = 0; i < 10; i++){
+      shift[(int)order[i]] = i*materialBits;
+      weight[(int)order[i]] = 1ULL << (i*materialBits);
+    }
+  }
+
+  int
+  count(unsigned long long key, UInt8 piece){
+    return (key >> shift[piece]) & 15;
+  }
+};
+
+materialSignatures material;
+
+class boardState;
+bool moverLeftKingInCheck(boardState* state);
+
 class boardState
 {
 public:
@@ -78,6 +301,17 @@ public:
   int  enPassantPos;
   int halfMoves;
   int fullMoves;
+  //zobrist key and eval sums, forceMove keeps them up to date so board writes there go through setSquare
+  unsigned long long key;
+  unsigned long long pawnKey;//pawns only, for the pawn structure cache
+  unsigned long long materialKey;//piece counts, see materialSignatures
+  int mgScore;//white's point of view
+  int egScore;
+  int gamePhase;
+  //where the kings and minor pieces are, white then black, so the search's eval never scans the board
+  int kingPos[2];
+  unsigned long long knights[2];//bit per square, a8 = bit 0
+  unsigned long long bishops[2];
 
   boardState(){
     memcpy(&board, &startingBoard, sizeof(startingBoard));
@@ -89,6 +323,182 @@ public:
     enPassantPos = -1;
     halfMoves = 0;
     fullMoves = 1;
+    refreshIncremental();
+  }
+
+  int
+  castlingRights(void){
+    return (whiteCanCastleKingSide ? 1 : 0)|(whiteCanCastleQueenSide ? 2 : 0)|(blackCanCastleKingSide ? 4 : 0)|(blackCanCastleQueenSide ? 8 : 0);
+  }
+
+  unsigned long long
+  computeKey(void){
+    unsigned long long k = zobrist.castling[castlingRights()];
+    for(int i = 0; i < 64; i++){
+      if(board[i] != EMPTY){
+	k ^= zobrist.piece(board[i], i);
+      }
+    }
+    if(enPassantPos != -1){
+      k ^= zobrist.enPassantFile[enPassantPos%8];
+    }
+    if(!isWhitesTurn){
+      k ^= zobrist.blackToMove;
+    }
+    return k;
+  }
+
+  unsigned long long
+  computePawnKey(void){
+    unsigned long long k = 0;
+    for(int i = 0; i < 64; i++){
+      if((board[i] == 'P')||(board[i] == 'p')){
+	k ^= zobrist.piece(board[i], i);
+      }
+    }
+    return k;
+  }
+
+  unsigned long long
+  computeMaterialKey(void){
+    unsigned long long k = 0;
+    for(int i = 0; i < 64; i++){
+      k += material.weight[board[i]];
+    }
+    return k;
+  }
+
+  void
+  computePieceSquares(int kings[2], unsigned long long minorKnights[2], unsigned long long minorBishops[2]){
+    for(int side = 0; side < 2; side++){
+      kings[side] = -1;
+      minorKnights[side] = 0;
+      minorBishops[side] = 0;
+    }
+    for(int i = 0; i < 64; i++){
+      int side = isupper(board[i]) ? 0 : 1;
+      switch(tolower(board[i])){
+      case BK: kings[side] = i; break;
+      case BN: minorKnights[side] |= 1ULL << i; break;
+      case BB: minorBishops[side] |= 1ULL << i; break;
+      }
+    }
+  }
+
+  //what setSquare does to kingPos/knights/bishops for one piece arriving or leaving
+  void
+  trackPiece(UInt8 piece, int pos, bool arriving){
+    int side = isupper(piece) ? 0 : 1;
+    switch(tolower(piece)){
+    case BK:
+      if(arriving){
+	kingPos[side] = pos;
+      }else if(kingPos[side] == pos){
+	kingPos[side] = -1;//a king move puts it on the new square before clearing the old one
+      }
+      break;
+    case BN: knights[side] ^= 1ULL << pos; break;
+    case BB: bishops[side] ^= 1ULL << pos; break;
+    }
+  }
+
+  //neither side can ever mate whatever is played: bare kings, one minor piece, or bishops that all stand on one colour
+  bool
+  isInsufficientMaterial(void){
+    const unsigned long long majorsAndPawns = (0xFULL | (0xFFULL << 12)) * (1 | (1ULL << 20));//pawns, rooks and queens of both sides
+    if(materialKey & majorsAndPawns){
+      return false;
+    }
+    int knights = material.count(materialKey, WN) + material.count(materialKey, BN);
+    int bishops = material.count(materialKey, WB) + material.count(materialKey, BB);
+    if(knights+bishops <= 1){
+      return true;
+    }
+    if(knights > 0){
+      return false;
+    }
+    //only a scan when it's bishops alone, which hardly ever happens
+    int colours = 0;
+    for(int i = 0; i < 64; i++){
+      if(tolower(board[i]) == BB){
+	colours |= 1 << (((i%8)+(i/8)) & 1);
+      }
+    }
+    return colours != 3;
+  }
+
+  void
+  computeEval(int* mg, int* eg, int* phase){
+    *mg = 0;
+    *eg = 0;
+    *phase = 0;
+    for(int i = 0; i < 64; i++){
+      *mg += pst.mg[board[i]][i];
+      *eg += pst.eg[board[i]][i];
+      *phase += pst.phase[board[i]];
+    }
+  }
+
+  //after writing board[] directly
+  void
+  refreshIncremental(void){
+    key = computeKey();
+    pawnKey = computePawnKey();
+    materialKey = computeMaterialKey();
+    computeEval(&mgScore, &egScore, &gamePhase);
+    computePieceSquares(kingPos, knights, bishops);
+  }
+
+  //debug check, what forceMove kept up to date against a recompute from scratch
+  bool
+  incrementalMatches(void){
+    int mg, eg, phase;
+    computeEval(&mg, &eg, &phase);
+    int kings[2];
+    unsigned long long minorKnights[2], minorBishops[2];
+    computePieceSquares(kings, minorKnights, minorBishops);
+    bool piecesMatch = true;
+    for(int side = 0; side < 2; side++){
+      piecesMatch = piecesMatch&&(kings[side] == kingPos[side])&&(minorKnights[side] == knights[side])&&(minorBishops[side] == bishops[side]);
+    }
+    return piecesMatch&&(key == computeKey())&&(pawnKey == computePawnKey())&&(materialKey == computeMaterialKey())&&(mg == mgScore)&&(eg == egScore)&&(phase == gamePhase);
+  }
+
+  //tapered material + piece square eval in centipawns, white's point of view, no work beyond the blend
+  int
+  taperedEval(void){
+    return taper(mgScore, egScore);
+  }
+
+  //blend of a middlegame and an endgame score by how much material is left
+  int
+  taper(int mg, int eg){
+    int phase = (gamePhase < maxGamePhase) ? gamePhase : maxGamePhase;
+    return (mg*phase + eg*(maxGamePhase-phase))/maxGamePhase;
+  }
+
+  void
+  setSquare(int pos, UInt8 piece){
+    UInt8 old = board[pos];
+    if(old != EMPTY){
+      key ^= zobrist.piece(old, pos);
+      if((old == 'P')||(old == 'p')){
+	pawnKey ^= zobrist.piece(old, pos);
+      }
+      trackPiece(old, pos, false);
+    }
+    if(piece != EMPTY){
+      key ^= zobrist.piece(piece, pos);
+      if((piece == 'P')||(piece == 'p')){
+	pawnKey ^= zobrist.piece(piece, pos);
+      }
+      trackPiece(piece, pos, true);
+    }
+    materialKey += material.weight[piece] - material.weight[old];
+    mgScore += pst.mg[piece][pos] - pst.mg[old][pos];
+    egScore += pst.eg[piece][pos] - pst.eg[old][pos];
+    gamePhase += pst.phase[piece] - pst.phase[old];
+    board[pos] = piece;
   }
 
   bool
@@ -238,6 +648,90 @@ public:
 
     return boardFen;
   }
+
+  //false for anything that isn't a legal position, the check test needs generateDistanceToEdge done first
+  bool
+  loadFromFen(const char* fen)
+  {
+    boardState loaded;
+    memset(loaded.board, EMPTY, sizeof(loaded.board));
+    const char* p = fen;
+    while(*p == ' '){
+      p++;
+    }
+    int x = 0;
+    int y = 0;
+    int kings[2] = {0, 0};
+    while((*p != ' ')&&(*p != '\0')){
+      char c = *p++;
+      if(c == '/'){
+	if(x != 8){
+	  return false;
+	}
+	x = 0;
+	y++;
+	if(y >= 8){
+	  return false;
+	}
+      }else if((c >= '1')&&(c <= '8')){
+	x += c-'0';
+	if(x > 8){
+	  return false;
+	}
+      }else if(strchr("pnbrqkPNBRQK", c) != NULL){
+	if(x >= 8){
+	  return false;
+	}
+	loaded.board[(y*8)+x] = c;
+	if(tolower(c) == BK){
+	  kings[isupper(c) ? 0 : 1]++;
+	}
+	x++;
+      }else{
+	return false;
+      }
+    }
+    if((y != 7)||(x != 8)){
+      return false;
+    }
+
+    char side = 'w';
+    char castling[8] = "-";
+    char enPassant[4] = "-";
+    int halfMoves_ = 0;
+    int fullMoves_ = 1;
+    int numRead = sscanf(p, " %c %7s %3s %d %d", &side, castling, enPassant, &halfMoves_, &fullMoves_);
+    if(numRead < 2){
+      return false;
+    }
+    if((side != 'w')&&(side != 'b')){
+      return false;
+    }
+    loaded.isWhitesTurn = (side == 'w');
+    loaded.whiteCanCastleKingSide = (strchr(castling, 'K') != NULL);
+    loaded.whiteCanCastleQueenSide = (strchr(castling, 'Q') != NULL);
+    loaded.blackCanCastleKingSide = (strchr(castling, 'k') != NULL);
+    loaded.blackCanCastleQueenSide = (strchr(castling, 'q') != NULL);
+    loaded.enPassantPos = -1;
+    if(enPassant[0] != '-'){
+      int epX = enPassant[0]-'a';
+      int epY = '8'-enPassant[1];
+      if(!((epX >= 0)&&(epX < 8)&&(epY >= 0)&&(epY < 8))){
+	return false;
+      }
+      loaded.enPassantPos = epX + (epY*8);
+    }
+    loaded.halfMoves = halfMoves_;
+    loaded.fullMoves = fullMoves_;
+    loaded.refreshIncremental();
+    //everything else assumes one king a side, and the side not to move can't be in check
+    if((kings[0] != 1)||(kings[1] != 1)||moverLeftKingInCheck(&loaded)){
+      return false;
+    }
+
+    *this = loaded;
+    return true;
+  }
 };
 
 class chessGame
@@ -284,6 +778,7 @@ public:
   
   static void
   forceMove(move forcedMove, boardState* state){
+    PERF_REGION(perfRegion_forceMove);
     int fromPos = forcedMove.from;
     int toPos = forcedMove.to;
     
@@ -291,8 +786,9 @@ public:
     int fromY = fromPos/8;
     int toX = toPos%8;
     int toY = toPos/8;
-    
-    
+
+    int oldCastlingRights = state->castlingRights();
+    int oldEnPassantPos = state->enPassantPos;
     
     if((state->isPawn(fromPos))||(!state->isEmpty(toPos))){
       state->halfMoves = 0;
@@ -311,12 +807,12 @@ public:
 	if((fromX == 4)&&(fromY == 0)){
 	  if(toY == 0){
 	    if(toX == 2){
-	      state->board[0] = EMPTY;
-	      state->board[3] = BR;
+	      state->setSquare(0, EMPTY);
+	      state->setSquare(3, BR);
 	    }
 	    if(toX == 6){
-	      state->board[7] = EMPTY;
-	      state->board[5] = BR;
+	      state->setSquare(7, EMPTY);
+	      state->setSquare(5, BR);
 	    }
 	  }
 	}
@@ -327,12 +823,12 @@ public:
 	if((fromX == 4)&&(fromY == 7)){
 	  if(toY == 7){
 	    if(toX == 2){
-	      state->board[56] = EMPTY;
-	      state->board[59] = WR;
+	      state->setSquare(56, EMPTY);
+	      state->setSquare(59, WR);
 	    }
 	    if(toX == 6){
-	      state->board[63] = EMPTY;
-	      state->board[61] = WR;
+	      state->setSquare(63, EMPTY);
+	      state->setSquare(61, WR);
 	    }
 	  }
 	}
@@ -373,10 +869,10 @@ public:
     if(state->isPawn(fromPos)){
       if(toPos == state->enPassantPos){
 	if(state->isWhite(fromPos)){
-	  state->board[toPos+dirDown] = EMPTY;
+	  state->setSquare(toPos+dirDown, EMPTY);
 	}
 	if(state->isBlack(fromPos)){
-	  state->board[toPos+dirUp] = EMPTY;
+	  state->setSquare(toPos+dirUp, EMPTY);
 	}
       }
     }
@@ -393,6 +889,13 @@ public:
     }
     
     state->isWhitesTurn = !state->isWhitesTurn;
+    state->key ^= zobrist.castling[oldCastlingRights] ^ zobrist.castling[state->castlingRights()] ^ zobrist.blackToMove;
+    if(oldEnPassantPos != -1){
+      state->key ^= zobrist.enPassantFile[oldEnPassantPos%8];
+    }
+    if(state->enPassantPos != -1){
+      state->key ^= zobrist.enPassantFile[state->enPassantPos%8];
+    }
 
 
     char promotion = forcedMove.promotion;
@@ -400,47 +903,49 @@ public:
       if(state->isWhite(fromPos)){
 	if(toY == 0){
 	  if(promotion == 'q'){
-	    state->board[toPos] = 'Q';
+	    state->setSquare(toPos, 'Q');
 	  }else if(promotion == 'r'){
-	    state->board[toPos] = 'R';
+	    state->setSquare(toPos, 'R');
 	  }else if(promotion == 'b'){
-	    state->board[toPos] = 'B';
+	    state->setSquare(toPos, 'B');
 	  }else if(promotion == 'n'){
-	    state->board[toPos] = 'N';
+	    state->setSquare(toPos, 'N');
 	  }else{
 	    printf("WHITE promotion is something wierd: '%c'\n", promotion);
 	    assert(false);
 	  }
-	  state->board[fromPos] = EMPTY;
+	  state->setSquare(fromPos, EMPTY);
 	  return;
 	}
       }
       if(state->isBlack(fromPos)){
 	if(toY == 7){
 	  if(promotion == 'q'){
-	    state->board[toPos] = 'q';
+	    state->setSquare(toPos, 'q');
 	  }else if(promotion == 'r'){
-	    state->board[toPos] = 'r';
+	    state->setSquare(toPos, 'r');
 	  }else if(promotion == 'b'){
-	    state->board[toPos] = 'b';
+	    state->setSquare(toPos, 'b');
 	  }else if(promotion == 'n'){
-	    state->board[toPos] = 'n';
+	    state->setSquare(toPos, 'n');
 	  }else{
 	    printf("BLACK promotion is something wierd: '%c'\n", promotion);
 	    assert(false);
 	  }
-	  state->board[fromPos] = EMPTY;
+	  state->setSquare(fromPos, EMPTY);
 	  return;
 	}
       }
     }
-    state->board[toPos] = state->board[fromPos];
-    state->board[fromPos] = EMPTY;
+    state->setSquare(toPos, state->board[fromPos]);
+    state->setSquare(fromPos, EMPTY);
     
   }
 
   static std::vector<move>
   generatePseudoLegalMoves(boardState* state){
+    PERF_REGION(perfRegion_generatePseudoLegalMoves);
+    ALLOC_SUBSYSTEM(allocSubsystem_movegen);
     std::vector<move> moveList;
     for(int i = 0; i < 64; i++){
       if((state->isWhitesTurn&&state->isWhite(i))||((!state->isWhitesTurn)&&state->isBlack(i))){
@@ -660,6 +1165,8 @@ public:
 
   static bool
   isInCheck(boardState* state, bool isWhite){
+    PERF_REGION(perfRegion_isInCheck);
+    ALLOC_SUBSYSTEM(allocSubsystem_movegen);
     bool tmp = state->isWhitesTurn;
     state->isWhitesTurn = !isWhite;
     std::vector<move> moves = generatePseudoLegalMoves(state);
@@ -685,14 +1192,86 @@ public:
     return false;
   }
   
+  static int
+  findKing(boardState* state, bool isWhite){
+    return state->kingPos[isWhite ? 0 : 1];
+  }
+
+  //squares of every piece of one side attacking pos, doesn't care whether moving there would be legal
+  static int
+  attackersOfSquare(boardState* state, int pos, bool byWhite, int attackers[16]){
+    int numAttackers = 0;
+    int x = pos%8;
+    int y = pos/8;
+    for(int dir = 0; dir < 8; dir++){
+      for(int s = 1; s < numSquaresTillEdge[pos][dir]; s++){
+	int from = pos + s*directions[dir];
+	if(state->isEmpty(from)){
+	  continue;
+	}
+	if(byWhite ? state->isWhite(from) : state->isBlack(from)){
+	  bool straight = (dir < 4);
+	  if(state->isQueen(from)||(straight&&state->isRook(from))||((!straight)&&state->isBishop(from))||((s == 1)&&state->isKing(from))){
+	    attackers[numAttackers++] = from;
+	  }
+	}
+	break;
+      }
+    }
+    const int knightJumps[8][2] = {{1, 2}, {2, 1}, {2, -1}, {1, -2}, {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2}};
+    for(int i = 0; i < 8; i++){
+      int fx = x + knightJumps[i][0];
+      int fy = y + knightJumps[i][1];
+      if((fx < 0)||(fx >= 8)||(fy < 0)||(fy >= 8)){
+	continue;
+      }
+      int from = fx + (fy*8);
+      if(state->isKnight(from)&&(byWhite ? state->isWhite(from) : state->isBlack(from))){
+	attackers[numAttackers++] = from;
+      }
+    }
+    int pawnY = byWhite ? y+1 : y-1;//white pawns attack up the board, so they sit below the square
+    if((pawnY >= 0)&&(pawnY < 8)){
+      for(int dx = -1; dx <= 1; dx += 2){
+	int fx = x + dx;
+	if((fx < 0)||(fx >= 8)){
+	  continue;
+	}
+	int from = fx + (pawnY*8);
+	if(state->board[from] == (byWhite ? WP : BP)){
+	  attackers[numAttackers++] = from;
+	}
+      }
+    }
+    return numAttackers;
+  }
+
   static std::vector<move>
   generateLegalMoves(boardState* state){
+    TRACE_SPAN("generateLegalMoves");
+    ALLOC_SUBSYSTEM(allocSubsystem_movegen);
     std::vector<move> pseudoLegals = generatePseudoLegalMoves(state);
 
     std::vector<move> legalMoves;
     
     bool isWhite = state->isWhitesTurn;
+    int wasInCheck = -1;
     for(int i = 0; i < (int)pseudoLegals.size(); i++){
+      int fromPos = pseudoLegals[i].from;
+      int toPos = pseudoLegals[i].to;
+      if((state->isKing(fromPos))&&(abs(toPos-fromPos) == 2)){//castling, can't castle out of or through check
+	if(wasInCheck == -1){
+	  wasInCheck = isInCheck(state, isWhite);
+	}
+	if(wasInCheck){
+	  continue;
+	}
+	boardState passing = *state;
+	forceMove(move(fromPos, (fromPos+toPos)/2), &passing);
+	if(isInCheck(&passing, isWhite)){
+	  continue;
+	}
+      }
       boardState tmp = *state;
       forceMove(pseudoLegals[i], &tmp);
       if(!isInCheck(&tmp, isWhite)){
@@ -765,14 +1344,20 @@ public:
   }
 };
 
+//the side that just moved has its king attacked, a position no legal game reaches
+bool
+moverLeftKingInCheck(boardState* state){
+  return chessGame::isInCheck(state, !state->isWhitesTurn);
+}
+
 
-int
+long long
 nodeTree(int depth, boardState state){
   if(depth == 0){
     return 1;
   }
 
-  int numStatesOnBranch = 0;
+  long long numStatesOnBranch = 0;
   std::vector<move> moveList = chessGame::generateLegalMoves(&state);
   for(int i = 0; i < (int)moveList.size(); i++){
     boardState tmp = state;
@@ -783,16 +1368,17 @@ nodeTree(int depth, boardState state){
   return numStatesOnBranch;
 }
 
-int
+long long
 nodeTest(int depth, boardState state){
-  int total = 0;
+  PERF_REGION(perfRegion_perft);
+  long long total = 0;
   std::vector<move> moveList = chessGame::generateLegalMoves(&state);
 
   
   for(int i = 0; i < (int)moveList.size(); i++){
     boardState tmp = state;
     chessGame::forceMove(moveList[i], &tmp);
-    int thisBranch = nodeTree(depth-1, tmp);
+    long long thisBranch = nodeTree(depth-1, tmp);
     total += thisBranch;
     
     
@@ -800,11 +1386,161 @@ nodeTest(int depth, boardState state){
     int fromY = moveList[i].from/8;
     int toX = moveList[i].to%8;
     int toY = moveList[i].to/8;
-    printf("%c%c%c%c = %d\n", 'a' + fromX, '8' - fromY, 'a' + toX, '8' - toY, thisBranch);
+    printf("%c%c%c%c = %lld\n", 'a' + fromX, '8' - fromY, 'a' + toX, '8' - toY, thisBranch);
   }
   return total;
 }
 
+//reference node counts from the chess programming wiki perft results page
+class perftPosition {
+public:
+  const char* name;
+  const char* fen;
+  int depth;
+  int expectedNodes;
+};
+
+const perftPosition perftSuite[] = {
+  {"startpos", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 4, 197281},
+  {"kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 3, 97862},
+  {"position3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 4, 43238},
+  {"position4", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 3, 9467},
+  {"position5", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 3, 62379},
+  {"position6", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", 3, 89890},
+  {"castle-prevented", "r3k2r/8/3Q4/8/8/5q2/8/R3K2R b KQkq - 0 1", 3, 50509},//both queens cover squares the kings would cross
+};
+const int numPerftSuite = sizeof(perftSuite)/sizeof(perftSuite[0]);
+
+class perftStats {
+public:
+  long long nodes = 0;
+  long long captures = 0;
+  long long enPassants = 0;
+  long long castles = 0;
+  long long promotions = 0;
+  long long checks = 0;
+  long long discoveredChecks = 0;
+  long long doubleChecks = 0;
+  long long checkmates = 0;
+
+  void
+  add(perftStats* other){
+    nodes += other->nodes;
+    captures += other->captures;
+    enPassants += other->enPassants;
+    castles += other->castles;
+    promotions += other->promotions;
+    checks += other->checks;
+    discoveredChecks += other->discoveredChecks;
+    doubleChecks += other->doubleChecks;
+    checkmates += other->checkmates;
+  }
+};
+
+void
+addPerftLeaf(boardState* before, move leafMove, boardState* after, perftStats* stats){
+  int from = leafMove.from;
+  int to = leafMove.to;
+  stats->nodes++;
+  bool isEnPassant = before->isPawn(from)&&(to == before->enPassantPos)&&((from%8) != (to%8));
+  if((!before->isEmpty(to))||isEnPassant){
+    stats->captures++;
+  }
+  if(isEnPassant){
+    stats->enPassants++;
+  }
+  bool isCastle = before->isKing(from)&&(abs(to-from) == 2);
+  if(isCastle){
+    stats->castles++;
+  }
+  if(leafMove.promotion != '\0'){
+    stats->promotions++;
+  }
+
+  int kingPos = chessGame::findKing(after, after->isWhitesTurn);
+  int checkers[16];
+  int numCheckers = chessGame::attackersOfSquare(after, kingPos, !after->isWhitesTurn, checkers);
+  if(numCheckers == 0){
+    return;
+  }
+  stats->checks++;
+  //double checks are only counted as double checks, like the published tables do
+  int castledRookPos = (from+to)/2;
+  if(numCheckers > 1){
+    stats->doubleChecks++;
+  }else if((checkers[0] != to)&&!(isCastle&&(checkers[0] == castledRookPos))){
+    stats->discoveredChecks++;
+  }
+  if(chessGame::generateLegalMoves(after).size() == 0){
+    stats->checkmates++;
+  }
+}
+
+//same walk as nodeTree, the move kinds are only looked at on the last ply where the nodes are counted
+void
+nodeTreeStats(int depth, boardState state, perftStats* stats){
+  std::vector<move> moveList = chessGame::generateLegalMoves(&state);
+  for(int i = 0; i < (int)moveList.size(); i++){
+    boardState tmp = state;
+    chessGame::forceMove(moveList[i], &tmp);
+    if(depth > 1){
+      nodeTreeStats(depth-1, tmp, stats);
+    }else{
+      addPerftLeaf(&state, moveList[i], &tmp, stats);
+    }
+  }
+}
+
+void
+printPerftStatsHeader(const char* firstColumn){
+  printf("%-8s %12s %10s %8s %8s %10s %9s %10s %8s %10s\n", firstColumn, "nodes", "captures", "e.p.", "castles", "promotions", "checks", "discovery", "double", "checkmates");
+}
+
+void
+printPerftStatsRow(const char* firstColumn, perftStats* stats){
+  printf("%-8s %12lld %10lld %8lld %8lld %10lld %9lld %10lld %8lld %10lld\n", firstColumn, stats->nodes, stats->captures, stats->enPassants, stats->castles,
+	 stats->promotions, stats->checks, stats->discoveredChecks, stats->doubleChecks, stats->checkmates);
+}
+
+//the divide from nodeTest with every counter per root move
+perftStats
+nodeTestStats(int depth, boardState state){
+  PERF_REGION(perfRegion_perft);
+  perftStats total;
+  std::vector<move> moveList = chessGame::generateLegalMoves(&state);
+  printPerftStatsHeader("move");
+  for(int i = 0; i < (int)moveList.size(); i++){
+    perftStats thisBranch;
+    boardState tmp = state;
+    chessGame::forceMove(moveList[i], &tmp);
+    if(depth > 1){
+      nodeTreeStats(depth-1, tmp, &thisBranch);
+    }else{
+      addPerftLeaf(&state, moveList[i], &tmp, &thisBranch);
+    }
+    total.add(&thisBranch);
+
+    char name[8];
+    snprintf(name, sizeof(name), "%c%c%c%c%c", 'a' + (moveList[i].from%8), '8' - (moveList[i].from/8), 'a' + (moveList[i].to%8), '8' - (moveList[i].to/8), moveList[i].promotion);
+    printPerftStatsRow(name, &thisBranch);
+  }
+  printPerftStatsRow("total", &total);
+  return total;
+}
+
+//the usual per depth perft results table
+void
+perftStatsTable(int maxDepth, boardState state){
+  printPerftStatsHeader("depth");
+  for(int depth = 1; depth <= maxDepth; depth++){
+    perftStats stats;
+    nodeTreeStats(depth, state, &stats);
+    char name[12];
+    snprintf(name, sizeof(name), "%d", depth);
+    printPerftStatsRow(name, &stats);
+  }
+}
+
 void
 generateDistanceToEdge(void){
   for(int startPos = 0; startPos < 64; startPos++){
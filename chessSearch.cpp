@@ -0,0 +1,1124 @@
+//in-process search, iterative deepening negamax alpha-beta with principal variation search
+//plays the same role as engine (getBestMove + the info_* fields the gui draws) without a stockfish process
+
+#include <math.h>
+#include <time.h>
+
+#include <atomic>
+#include <algorithm>
+#include <thread>
+
+const int searchInfinity = 32000;
+const int mateScore = 31000;
+const int maxSearchPly = 128;
+//anything this close to mateScore is a mate found within the search
+const int mateThreshold = mateScore-maxSearchPly;
+static_assert(nnueMaxEval < mateThreshold, "network evals must never read as mates");
+
+//plain material for move ordering and exchanges, the eval itself is boardState's piece square sums
+int
+pieceValue(UInt8 piece){
+  switch(tolower(piece)){
+  case BP: return 100;
+  case BN: return 320;
+  case BB: return 330;
+  case BR: return 500;
+  case BQ: return 900;
+  default: return 0;
+  }
+}
+
+//a knight or bishop defended by a pawn where no enemy pawn can ever attack it
+const int outpostKnightMg = 20;
+const int outpostKnightEg = 10;
+const int outpostBishopMg = 10;
+const int outpostBishopEg = 5;
+
+//piece square sums boardState keeps up to date, pawn structure from the cache, king shelter and outposts, side to move's point of view
+int
+evaluate(boardState* state, pawnHashTable* pawns){
+  pawnEntry* entry = pawns->probe(state);
+  int mg = state->mgScore + entry->mg;
+  int eg = state->egScore + entry->eg;
+  mg += entry->shelter[0][state->kingPos[0]%8] - entry->shelter[1][state->kingPos[1]%8];
+  for(int side = 0; side < 2; side++){
+    int sign = (side == 0) ? 1 : -1;
+    unsigned long long outposts = entry->attacks[side] & ~entry->attackSpans[1-side];
+    int outpostKnights = __builtin_popcountll(state->knights[side] & outposts);
+    int outpostBishops = __builtin_popcountll(state->bishops[side] & outposts);
+    mg += sign*(outpostKnights*outpostKnightMg + outpostBishops*outpostBishopMg);
+    eg += sign*(outpostKnights*outpostKnightEg + outpostBishops*outpostBishopEg);
+  }
+  int score = state->taper(mg, eg);
+  return state->isWhitesTurn ? score : -score;
+}
+
+//cheaper than isInCheck, only looks outward from the king instead of generating every enemy move
+bool
+kingAttacked(boardState* state, bool isWhite){
+  int attackers[16];
+  int king = chessGame::findKing(state, isWhite);
+  return chessGame::attackersOfSquare(state, king, !isWhite, attackers) > 0;
+}
+
+//captures, en passant and queen promotions, what quiescence looks at
+bool
+isTactical(boardState* state, move m){
+  if(state->board[m.to] != EMPTY){
+    return true;
+  }
+  if(state->isPawn(m.from)&&((m.to == state->enPassantPos)||(m.promotion == 'q'))){
+    return true;
+  }
+  return false;
+}
+
+int
+seeValue(UInt8 piece){
+  return (tolower(piece) == BK) ? 20000 : pieceValue(piece);
+}
+
+//static exchange evaluation, material balance after both sides keep recapturing on m.to with their cheapest piece
+//attackers get recomputed after every capture on a scratch board so x-rays behind the moved pieces join in
+int
+staticExchange(boardState* state, move m){
+  boardState scratch = *state;
+  int gain[32];
+  int d = 0;
+  //the mover is read once up front, indexing board[m.from] after isPawn/isWhite's range checks trips gcc 12's -Warray-bounds
+  UInt8 onSquare = state->board[m.from];
+  bool moverIsWhite = isupper(onSquare);
+  gain[0] = pieceValue(scratch.board[m.to]);
+  if((tolower(onSquare) == BP)&&(m.to == state->enPassantPos)){
+    gain[0] = pieceValue(BP);
+    scratch.board[m.to + (moverIsWhite ? dirDown : dirUp)] = EMPTY;
+  }
+  scratch.board[m.from] = EMPTY;
+  bool byWhite = !moverIsWhite;
+  while(d < 31){
+    d++;
+    gain[d] = seeValue(onSquare) - gain[d-1];
+    if(std::max(-gain[d-1], gain[d]) < 0){
+      break;//neither side can come out ahead by carrying on
+    }
+    int attackers[16];
+    int numAttackers = chessGame::attackersOfSquare(&scratch, m.to, byWhite, attackers);
+    if(numAttackers == 0){
+      break;
+    }
+    int cheapest = attackers[0];
+    for(int i = 1; i < numAttackers; i++){
+      if(seeValue(scratch.board[attackers[i]]) < seeValue(scratch.board[cheapest])){
+	cheapest = attackers[i];
+      }
+    }
+    onSquare = scratch.board[cheapest];
+    scratch.board[cheapest] = EMPTY;
+    byWhite = !byWhite;
+  }
+  while(--d > 0){
+    gain[d-1] = -std::max(-gain[d-1], gain[d]);
+  }
+  return gain[0];
+}
+
+//mate scores are stored relative to the node so they stay right when the position turns up at another ply
+int
+scoreToTable(int score, int ply){
+  if(score >= mateThreshold){
+    return score+ply;
+  }
+  if(score <= -mateThreshold){
+    return score-ply;
+  }
+  return score;
+}
+
+int
+scoreFromTable(int score, int ply){
+  if(score >= mateThreshold){
+    return score-ply;
+  }
+  if(score <= -mateThreshold){
+    return score+ply;
+  }
+  return score;
+}
+
+bool
+sameMove(move a, move b){
+  return (a.from == b.from)&&(a.to == b.to)&&(a.promotion == b.promotion);
+}
+
+void
+moveToString(move m, char buffer[6]){
+  buffer[0] = 'a' + (m.from%8);
+  buffer[1] = '8' - (m.from/8);
+  buffer[2] = 'a' + (m.to%8);
+  buffer[3] = '8' - (m.to/8);
+  buffer[4] = m.promotion;
+  buffer[5] = '\0';
+}
+
+//the pruning and extensions the search does on top of plain alpha-beta, each can be switched off to measure what it's worth
+class searchOptions {
+public:
+  bool nullMove = true;
+  bool lateMoveReductions = true;
+  bool futility = true;//reverse futility at the node and futility per move
+  bool checkExtensions = true;
+
+  //"nullmove,lmr" etc, false on a name it doesn't know
+  bool
+  disable(const char* names){
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "%s", names);
+    for(char* name = strtok(buffer, ","); name != NULL; name = strtok(NULL, ",")){
+      if(strcmp(name, "nullmove") == 0){
+	nullMove = false;
+      }else if(strcmp(name, "lmr") == 0){
+	lateMoveReductions = false;
+      }else if(strcmp(name, "futility") == 0){
+	futility = false;
+      }else if(strcmp(name, "checkext") == 0){
+	checkExtensions = false;
+      }else if(strcmp(name, "all") == 0){
+	nullMove = lateMoveReductions = futility = checkExtensions = false;
+      }else{
+	printf("unknown search option \"%s\", can disable nullmove, lmr, futility, checkext or all\n", name);
+	return false;
+      }
+    }
+    return true;
+  }
+};
+
+//late move reductions by depth and move number, log(depth)*log(moveNumber) so both have to be big before it reduces much
+class lateMoveReductionTable {
+public:
+  int reductions[64][64];
+
+  lateMoveReductionTable(void){
+    for(int depth = 0; depth < 64; depth++){
+      for(int moveNumber = 0; moveNumber < 64; moveNumber++){
+	reductions[depth][moveNumber] = (depth == 0 || moveNumber == 0) ? 0 : (int)(0.75 + log(depth)*log(moveNumber)/2.25);
+      }
+    }
+  }
+
+  int
+  get(int depth, int moveNumber){
+    return reductions[std::min(depth, 63)][std::min(moveNumber, 63)];
+  }
+};
+lateMoveReductionTable lmrTable;
+
+//passing, only for null move pruning, the key changes the same way forceMove changes it
+void
+makeNullMove(boardState* state){
+  if(state->enPassantPos != -1){
+    state->key ^= zobrist.enPassantFile[state->enPassantPos%8];
+    state->enPassantPos = -1;
+  }
+  state->isWhitesTurn = !state->isWhitesTurn;
+  state->key ^= zobrist.blackToMove;
+  state->halfMoves++;
+}
+
+//a side with only pawns and king is where zugzwang lives, passing there proves nothing
+bool
+hasPieces(boardState* state, bool isWhite){
+  return (state->materialKey & (isWhite ? materialWhitePiecesMask : materialBlackPiecesMask)) != 0;
+}
+
+//what every thread of one search shares, the table plus the stop flag and node count
+class searchShared {
+public:
+  transpositionTable table;
+  std::atomic<bool> stop{false};
+  std::atomic<long long> nodes{0};//workers add theirs in batches, close enough for limits and info lines
+  //atomic since a ponder hit sets the limits from the game thread while worker 0 is reading them
+  std::atomic<long long> startMs{0};
+  std::atomic<long long> moveTimeMs{0};
+  std::atomic<bool> pondering{false};//no time or node limits, only stop ends it
+  long long maxNodes;
+  nnueNetwork* network = NULL;//NULL evaluates with boardState's piece square sums
+  searchOptions options;
+  int multiPv = 1;
+};
+
+//what quiet moves get ordered by, one set per worker: killers per ply, butterfly history and countermoves
+class moveHistory {
+public:
+  static const int maxHistory = 16384;
+  move killers[maxSearchPly][2];
+  int butterfly[2][64][64];//[side to move][from][to], how often the move cut off, weighted by depth
+  move counterMoves[12][64];//[piece that just moved][where it went], the reply that refuted it last time
+
+  moveHistory(void){
+    memset(butterfly, 0, sizeof(butterfly));
+  }
+
+  //a new search keeps half of what it learnt, killers are for the old position's plies so they go
+  void
+  age(void){
+    for(int ply = 0; ply < maxSearchPly; ply++){
+      killers[ply][0] = move();
+      killers[ply][1] = move();
+    }
+    for(int side = 0; side < 2; side++){
+      for(int from = 0; from < 64; from++){
+	for(int to = 0; to < 64; to++){
+	  butterfly[side][from][to] /= 2;
+	}
+      }
+    }
+  }
+
+  //bonus shrinks as the entry fills up, so entries stay within +-maxHistory however often a move cuts
+  static void
+  addBonus(int* entry, int bonus){
+    *entry += bonus - (*entry)*abs(bonus)/maxHistory;
+  }
+
+  //best was quiet and failed high, everything quiet tried before it didn't
+  void
+  quietCutoff(boardState* state, move best, move previous, int ply, int depth, move* tried, int numTried){
+    if(!sameMove(killers[ply][0], best)){
+      killers[ply][1] = killers[ply][0];
+      killers[ply][0] = best;
+    }
+    int side = state->isWhitesTurn ? 0 : 1;
+    int bonus = std::min(depth*depth, 400);
+    addBonus(&butterfly[side][best.from][best.to], bonus);
+    for(int i = 0; i < numTried; i++){
+      addBonus(&butterfly[side][tried[i].from][tried[i].to], -bonus);
+    }
+    if(previous.from >= 0){
+      counterMoves[(int)zobrist.pieceIndex[state->board[previous.to]]][previous.to] = best;
+    }
+  }
+};
+
+//hash move, then captures and queen promotions by mvv-lva, killers, the countermove, then quiets by history
+const int orderHashMove = 1 << 30;
+const int orderTactical = 1 << 24;
+const int orderKiller = 1 << 23;
+const int orderCounterMove = 1 << 22;
+
+//scores the list once, then every pick is one pass for the best remaining move
+//a node that cuts off on its first move or two never pays for sorting the rest
+class movePicker {
+public:
+  std::vector<move>* moves;
+  int scores[256];
+  int count;
+  int next = 0;
+
+  movePicker(std::vector<move>* moves_){
+    moves = moves_;
+    count = std::min((int)moves->size(), 256);
+  }
+
+  bool
+  pick(move* out){
+    if(next >= count){
+      return false;
+    }
+    int best = next;
+    for(int i = next+1; i < count; i++){
+      if(scores[i] > scores[best]){
+	best = i;
+      }
+    }
+    std::swap((*moves)[next], (*moves)[best]);
+    std::swap(scores[next], scores[best]);
+    *out = (*moves)[next++];
+    return true;
+  }
+};
+
+//multipv, line 0 is the best root move's, line k the best once lines 0..k-1's first moves are left out
+const int maxMultiPv = 16;
+
+class rootLine {
+public:
+  move moves[maxSearchPly];
+  int length = 0;
+  int score = 0;
+};
+
+//one search thread, lazy smp style: every worker searches the same root and they only help each other through the table
+//worker 0 is the main thread, it's the only one that watches the clock
+class searchWorker {
+public:
+  int id;
+  searchShared* shared;
+  long long nodes;
+  bool stopped;
+  //triangular pv table, pv[ply] is the line found from ply on
+  move pv[maxSearchPly][maxSearchPly];
+  int pvLength[maxSearchPly];
+  //last finished iteration's line, tried first at each ply of the next one
+  //with multipv it's swapped for each line's own while that line is searched, and is line 0's again once the iteration is done
+  move previousPv[maxSearchPly];
+  int previousPvLength;
+  int completedDepth;
+  int completedScore;
+  rootLine lines[maxMultiPv];
+  int numLines;
+  //root moves already given a line this iteration, the next line is searched without them
+  move excludedRootMoves[maxMultiPv];
+  int numExcludedRootMoves = 0;
+  //accumulators[ply] belongs to the position being searched at that ply, only kept up to date with a network
+  nnueAccumulator* accumulators;
+  moveHistory history;
+  pawnHashTable pawns;
+  //the move made at each ply on the way to the current node, for countermoves, move() for a null move
+  move currentMove[maxSearchPly];
+  //off while verifying a null move cutoff so the verification can't pass its way to the same answer
+  bool nullMoveAllowed = true;
+
+  searchWorker(int id_, searchShared* shared_){
+    id = id_;
+    shared = shared_;
+    accumulators = new nnueAccumulator[maxSearchPly+1];
+  }
+
+  ~searchWorker(void){
+    delete[] accumulators;
+  }
+
+  int
+  evaluateNode(boardState* state, int ply){
+    int known;
+    if(endgameEvaluate(state, &known)){
+      return state->isWhitesTurn ? known : -known;
+    }
+    if(shared->network != NULL){
+      return nnueEvaluate(shared->network, &accumulators[ply], state->isWhitesTurn);
+    }
+    return evaluate(state, &pawns);
+  }
+
+  //call once child is known to be searched, it's the position at ply+1 now
+  void
+  enterChild(boardState* state, boardState* child, int ply){
+    if(shared->network != NULL){
+      nnueUpdate(shared->network, state, &accumulators[ply], child, &accumulators[ply+1]);
+    }
+  }
+
+  void
+  reset(void){
+    nodes = 0;
+    stopped = false;
+    previousPvLength = 0;
+    completedDepth = 0;
+    completedScore = 0;
+    numLines = 0;
+    pawns.probes = 0;
+    pawns.hits = 0;
+    history.age();
+  }
+
+  bool
+  outOfTime(void){
+    if(shared->stop){
+      return true;
+    }
+    if((id != 0)||shared->pondering){
+      return false;
+    }
+    if((shared->maxNodes > 0)&&(shared->nodes >= shared->maxNodes)){
+      return true;
+    }
+    return (shared->moveTimeMs > 0)&&(clockNowMs()-shared->startMs >= shared->moveTimeMs);
+  }
+
+  //helpers jitter the quiet moves a little differently each so they don't all walk the same tree
+  void
+  scoreMoves(boardState* state, movePicker* picker, move hashMove, int ply){
+    int side = state->isWhitesTurn ? 0 : 1;
+    move counter;
+    if((ply > 0)&&(currentMove[ply-1].from >= 0)){
+      move previous = currentMove[ply-1];
+      counter = history.counterMoves[(int)zobrist.pieceIndex[state->board[previous.to]]][previous.to];
+    }
+    for(int i = 0; i < picker->count; i++){
+      move m = (*picker->moves)[i];
+      int score;
+      if(sameMove(m, hashMove)){
+	score = orderHashMove;
+      }else if(isTactical(state, m)){
+	UInt8 victim = (state->board[m.to] != EMPTY) ? state->board[m.to] : BP;
+	score = orderTactical + 64*pieceValue(victim) - pieceValue(state->board[m.from])/16;
+	if(m.promotion == 'q'){
+	  score += 64*pieceValue(BQ);
+	}
+      }else if(sameMove(m, history.killers[ply][0])){
+	score = orderKiller+1;
+      }else if(sameMove(m, history.killers[ply][1])){
+	score = orderKiller;
+      }else if(sameMove(m, counter)){
+	score = orderCounterMove;
+      }else{
+	score = history.butterfly[side][m.from][m.to];
+	if(id != 0){
+	  score += (((m.from*64 + m.to)*2654435761u + id*40503u) >> 24) & 63;
+	}
+      }
+      picker->scores[i] = score;
+    }
+  }
+
+  //returns true once the search has to stop
+  bool
+  countNode(void){
+    nodes++;
+    if((nodes & 1023) == 0){
+      shared->nodes += 1024;
+      if(outOfTime()){
+	stopped = true;
+	shared->stop = true;
+      }
+    }
+    return stopped;
+  }
+
+  //captures only until the position is quiet, so the eval never sees a piece hanging halfway through an exchange
+  int
+  quiesce(boardState* state, int alpha, int beta, int ply){
+    pvLength[ply] = ply;
+    if(countNode()){
+      return 0;
+    }
+    //stand pat, the side to move doesn't have to capture
+    int bestScore = evaluateNode(state, ply);
+    if((bestScore >= beta)||(ply+1 >= maxSearchPly)){
+      return bestScore;
+    }
+    if(bestScore > alpha){
+      alpha = bestScore;
+    }
+
+    std::vector<move> moves = chessGame::generatePseudoLegalMoves(state);
+    int numTactical = 0;
+    for(int i = 0; i < (int)moves.size(); i++){
+      if(isTactical(state, moves[i])){
+	moves[numTactical++] = moves[i];
+      }
+    }
+    moves.resize(numTactical);
+    movePicker picker(&moves);
+    scoreMoves(state, &picker, move(), ply);
+
+    bool isWhite = state->isWhitesTurn;
+    move m;
+    while(picker.pick(&m)){
+      //losing captures can't raise a score that could already stand pat
+      if((m.promotion == '\0')&&(staticExchange(state, m) < 0)){
+	continue;
+      }
+      boardState child = *state;
+      chessGame::forceMove(m, &child);
+      if(kingAttacked(&child, isWhite)){
+	continue;
+      }
+      enterChild(state, &child, ply);
+      int score = -quiesce(&child, -beta, -alpha, ply+1);
+      if(stopped){
+	return 0;
+      }
+      if(score > bestScore){
+	bestScore = score;
+	if(score > alpha){
+	  alpha = score;
+	  if(alpha >= beta){
+	    break;
+	  }
+	}
+      }
+    }
+    return bestScore;
+  }
+
+  int
+  negamax(boardState* state, int depth, int alpha, int beta, int ply){
+    searchOptions* options = &shared->options;
+    bool inCheck = kingAttacked(state, state->isWhitesTurn);
+    //one more ply when in check so a check at the horizon doesn't hide what it leads to
+    if(inCheck&&options->checkExtensions&&(ply < maxSearchPly/2)){
+      depth++;
+    }
+    if(depth <= 0){
+      return quiesce(state, alpha, beta, ply);
+    }
+    pvLength[ply] = ply;
+    if(countNode()){
+      return 0;
+    }
+    if((ply > 0)&&(state->halfMoves > fifty_move_rule_max)){
+      return 0;
+    }
+    if((ply > 0)&&endgameIsExact(state)){
+      return evaluateNode(state, ply);
+    }
+
+    //only null window nodes take a cutoff from the table, a pv node would lose its line
+    bool pvNode = (beta-alpha > 1);
+    move hashMove;
+    ttHit hit;
+    if(shared->table.probe(state->key, &hit)){
+      hashMove = hit.bestMove;
+      int score = scoreFromTable(hit.score, ply);
+      if((!pvNode)&&(hit.depth >= depth)){
+	if((hit.bound == ttBound_exact)||((hit.bound == ttBound_lower)&&(score >= beta))||((hit.bound == ttBound_upper)&&(score <= alpha))){
+	  return score;
+	}
+      }
+    }
+
+    int staticEval = inCheck ? -searchInfinity : evaluateNode(state, ply);
+    if((!pvNode)&&(!inCheck)&&(abs(beta) < mateThreshold)){
+      //reverse futility, so far above beta that a few plies of the opponent's moves won't bring it back
+      if(options->futility&&(depth <= 6)&&(staticEval - 80*depth >= beta)){
+	return staticEval;
+      }
+      //null move, if passing still fails high a real move would too
+      //not twice in a row, not with only pawns left, and deep cutoffs get verified with a reduced search that can't pass
+      if(options->nullMove&&nullMoveAllowed&&(depth >= 2)&&(ply > 0)&&(currentMove[ply-1].from >= 0)&&(staticEval >= beta)&&hasPieces(state, state->isWhitesTurn)){
+	int reduction = 3 + depth/6 + std::min((staticEval-beta)/200, 2);
+	boardState child = *state;
+	makeNullMove(&child);
+	enterChild(state, &child, ply);
+	currentMove[ply] = move();
+	int score = -negamax(&child, depth-1-reduction, -beta, -beta+1, ply+1);
+	if(stopped){
+	  return 0;
+	}
+	if(score >= beta){
+	  if(score >= mateThreshold){
+	    score = beta;//a mate found by passing isn't a real one
+	  }
+	  if(depth < 10){
+	    return score;
+	  }
+	  nullMoveAllowed = false;
+	  int verified = negamax(state, depth-reduction, beta-1, beta, ply);
+	  nullMoveAllowed = true;
+	  if(verified >= beta){
+	    return score;
+	  }
+	}
+      }
+    }
+
+    std::vector<move> moves = chessGame::generateLegalMoves(state);
+    if(moves.size() == 0){
+      return inCheck ? (-mateScore + ply) : 0;
+    }
+    if(ply+1 >= maxSearchPly){
+      return evaluateNode(state, ply);
+    }
+
+    //the table's move first, or the previous iteration's line if the table lost it
+    //at the root the line wins, with multipv the table's move there is usually an earlier line's
+    move firstMove = hashMove;
+    if(((firstMove.from < 0)||(ply == 0))&&(previousPvLength > ply)){
+      firstMove = previousPv[ply];
+    }
+    movePicker picker(&moves);
+    scoreMoves(state, &picker, firstMove, ply);
+
+    int originalAlpha = alpha;
+    int bestScore = -searchInfinity;
+    move bestMove;
+    move quietsTried[256];
+    int numQuietsTried = 0;
+    int moveNumber = 0;
+    move m;
+    while(picker.pick(&m)){
+      if((ply == 0)&&isExcludedRootMove(m)){
+	continue;
+      }
+      bool quiet = !isTactical(state, m);
+      boardState child = *state;
+      chessGame::forceMove(m, &child);
+      bool givesCheck = kingAttacked(&child, child.isWhitesTurn);
+      bool boring = quiet&&(!inCheck)&&(!givesCheck)&&(moveNumber > 0);
+      //futility, near the leaves a quiet move can't make up a big enough deficit
+      if(boring&&(!pvNode)&&options->futility&&(depth <= 3)&&(bestScore > -mateThreshold)&&(staticEval + 100 + 150*depth <= alpha)){
+	continue;
+      }
+      enterChild(state, &child, ply);
+      currentMove[ply] = m;
+      int score;
+      if(moveNumber++ == 0){
+	score = -negamax(&child, depth-1, -beta, -alpha, ply+1);
+      }else{
+	//late quiet moves are unlikely to be best, search them shallower and only go back to full depth if they beat alpha
+	int reduction = 0;
+	if(boring&&options->lateMoveReductions&&(depth >= 3)&&(moveNumber > (pvNode ? 3 : 2))
+	   &&(!sameMove(m, history.killers[ply][0]))&&(!sameMove(m, history.killers[ply][1]))){
+	  reduction = lmrTable.get(depth, moveNumber) - (pvNode ? 1 : 0);
+	  reduction = std::max(0, std::min(reduction, depth-2));
+	}
+	//everything after the first move is assumed worse, prove it with a null window and only re-search if that fails
+	score = -negamax(&child, depth-1-reduction, -alpha-1, -alpha, ply+1);
+	if((reduction > 0)&&(score > alpha)){
+	  score = -negamax(&child, depth-1, -alpha-1, -alpha, ply+1);
+	}
+	if((score > alpha)&&(score < beta)){
+	  score = -negamax(&child, depth-1, -beta, -alpha, ply+1);
+	}
+      }
+      if(stopped){
+	return 0;
+      }
+      if(score > bestScore){
+	bestScore = score;
+	bestMove = m;
+	if(score > alpha){
+	  alpha = score;
+	  pv[ply][ply] = m;
+	  for(int p = ply+1; p < pvLength[ply+1]; p++){
+	    pv[ply][p] = pv[ply+1][p];
+	  }
+	  pvLength[ply] = pvLength[ply+1];
+	  if(alpha >= beta){
+	    if(quiet){
+	      history.quietCutoff(state, m, (ply > 0) ? currentMove[ply-1] : move(), ply, depth, quietsTried, numQuietsTried);
+	    }
+	    break;
+	  }
+	}
+      }
+      if(quiet){
+	quietsTried[numQuietsTried++] = m;
+      }
+    }
+    //a root searched without some of its moves hasn't got its real score
+    if((ply == 0)&&(numExcludedRootMoves > 0)){
+      return bestScore;
+    }
+    int bound = (bestScore >= beta) ? ttBound_lower : ((bestScore > originalAlpha) ? ttBound_exact : ttBound_upper);
+    shared->table.store(state->key, (bound == ttBound_upper) ? move() : bestMove, scoreToTable(bestScore, ply), depth, bound);
+    return bestScore;
+  }
+
+  bool
+  isExcludedRootMove(move m){
+    for(int i = 0; i < numExcludedRootMoves; i++){
+      if(sameMove(m, excludedRootMoves[i])){
+	return true;
+      }
+    }
+    return false;
+  }
+
+  //aspiration window around the line's last score, widened on whichever side it fails until the score lands inside
+  int
+  aspirate(boardState* root, int depth, int previousScore){
+    int delta = 25;
+    int alpha = -searchInfinity;
+    int beta = searchInfinity;
+    if((depth >= 5)&&(abs(previousScore) < mateThreshold)){
+      alpha = std::max(previousScore-delta, -searchInfinity);
+      beta = std::min(previousScore+delta, searchInfinity);
+    }
+    while(true){
+      int score = negamax(root, depth, alpha, beta, 0);
+      if(stopped){
+	return 0;
+      }
+      if((score <= alpha)&&(alpha > -searchInfinity)){
+	alpha = std::max(score-delta, -searchInfinity);
+      }else if((score >= beta)&&(beta < searchInfinity)){
+	beta = std::min(score+delta, searchInfinity);
+      }else{
+	return score;
+      }
+      delta *= 2;
+    }
+  }
+
+  //one iteration, every multipv line in turn, returns false if it got stopped partway and the result can't be used
+  //the lines share the table, so line k mostly finds line k-1's subtrees already searched
+  bool
+  searchRoot(boardState* state, int depth){
+    boardState root = *state;
+    if(shared->network != NULL){
+      nnueRefreshBoth(shared->network, &root, &accumulators[0]);
+    }
+    int wantedLines = std::min(std::min(shared->multiPv, maxMultiPv), (int)chessGame::generateLegalMoves(state).size());
+    rootLine found[maxMultiPv];
+    numExcludedRootMoves = 0;
+    for(int line = 0; line < wantedLines; line++){
+      bool hasPrevious = (line < numLines);
+      previousPvLength = hasPrevious ? lines[line].length : 0;
+      memcpy(previousPv, lines[line].moves, sizeof(move)*previousPvLength);
+      int score = aspirate(&root, depth, hasPrevious ? lines[line].score : 0);
+      if(stopped){
+	numExcludedRootMoves = 0;
+	previousPvLength = lines[0].length;
+	memcpy(previousPv, lines[0].moves, sizeof(move)*previousPvLength);
+	return false;
+      }
+      found[line].score = score;
+      found[line].length = pvLength[0];
+      memcpy(found[line].moves, pv[0], sizeof(move)*pvLength[0]);
+      excludedRootMoves[numExcludedRootMoves++] = pv[0][0];
+    }
+    numExcludedRootMoves = 0;
+    //a later line can come back better than an earlier one once it's been searched deeper than the earlier one's cut-offs
+    std::stable_sort(found, found+wantedLines, [](const rootLine& a, const rootLine& b){ return a.score > b.score; });
+    memcpy(lines, found, sizeof(rootLine)*wantedLines);
+    numLines = wantedLines;
+    completedDepth = depth;
+    completedScore = lines[0].score;
+    previousPvLength = lines[0].length;
+    memcpy(previousPv, lines[0].moves, sizeof(move)*previousPvLength);
+    return true;
+  }
+
+  //helpers start every other one a ply deeper so they're ahead of the main thread filling the table
+  void
+  helperLoop(boardState state, int maxDepth){
+    TRACE_THREAD_NAME("search helper");
+    for(int depth = 1 + (id & 1); depth <= maxDepth; depth++){
+      if(!searchRoot(&state, depth)){
+	break;
+      }
+    }
+  }
+};
+
+class searchEngine {
+public:
+  //limits, whichever runs out first ends the search
+  int maxDepth = maxSearchPly-1;
+  long long moveTimeMs = 1000;
+  long long maxNodes = 0;//0 is no limit
+  gameClock* clock = NULL;//when it's running the budget comes from the side to move's time instead of moveTimeMs
+  timeManager time;
+
+  //pondering, the search carries on in the position after the reply its pv expects while the other side thinks
+  std::thread ponderThread;
+  boardState ponderState;
+  move ponderResult;
+  move expectedReply;//second move of the last search's pv, what gets pondered
+  int numThreads = defaultSearchThreads();
+  bool verbose = true;
+
+  static const int defaultHashMegabytes = 16;
+  searchShared shared;
+  std::vector<searchWorker*> workers;
+
+  //same names as engine so the gui and analyse read either one the same way
+  int info_depth;
+  long long info_nodes;
+  int info_time;
+  int info_nps;
+  int info_score;
+  bool info_score_mate;
+  int info_hashfull;
+  static const int maxPvMoves = maxSearchPly;
+  int numPvMoves;
+  char info_pv[maxPvMoves][5];
+  //every multipv line, line 0 is the same as info_score/info_pv
+  //only the count gets reset, so after getBestMove the lines are still there for bestmove_numPvLines of them
+  int multiPv = 1;
+  int numPvLines;
+  int info_line_score[maxMultiPv];
+  bool info_line_score_mate[maxMultiPv];
+  int numLinePvMoves[maxMultiPv];
+  char info_line_pv[maxMultiPv][maxPvMoves][5];
+
+  int bestmove_depth = 0;
+  int bestmove_score = 0;
+  bool bestmove_score_mate = false;
+  int bestmove_numPvLines = 0;
+
+  searchEngine(void){
+    prepareEndgames();
+    shared.table.resize(defaultHashMegabytes);
+    resetSearchData();
+  }
+
+  ~searchEngine(void){
+    stopPondering();
+    for(int i = 0; i < (int)workers.size(); i++){
+      delete workers[i];
+    }
+    delete shared.network;
+  }
+
+  static int
+  defaultSearchThreads(void){
+    int count = std::thread::hardware_concurrency();
+    return (count > 0) ? count : 1;
+  }
+
+  //evaluate with a network from now on, false (and still piece square tables) if the file isn't one
+  bool
+  loadNetwork(const char* path){
+    nnueNetwork* network = new nnueNetwork();
+    if(!network->load(path)){
+      delete network;
+      return false;
+    }
+    delete shared.network;
+    shared.network = network;
+    return true;
+  }
+
+  void
+  setHashSize(int megabytes){
+    stopPondering();
+    shared.table.resize(megabytes);
+  }
+
+  void
+  newGame(void){
+    stopPondering();
+    shared.table.clear();
+  }
+
+  //state is the position the opponent is about to move in, returns straight away
+  void
+  ponder(boardState* state){
+    stopPondering();
+    if(expectedReply.from < 0){
+      return;
+    }
+    ponderState = *state;
+    chessGame::forceMove(expectedReply, &ponderState);
+    if(chessGame::generateLegalMoves(&ponderState).size() == 0){
+      return;
+    }
+    if(verbose){
+      char text[6];
+      moveToString(expectedReply, text);
+      printf("info string pondering %s\n", text);
+    }
+    shared.stop = false;
+    shared.pondering = true;
+    shared.startMs = clockNowMs();
+    ponderThread = std::thread([this](){ ponderResult = search(&ponderState, true); });
+  }
+
+  //the reply wasn't the one pondered, or the game moved on without it
+  void
+  stopPondering(void){
+    if(ponderThread.joinable()){
+      shared.stop = true;
+      ponderThread.join();
+    }
+    shared.pondering = false;
+  }
+
+  void
+  startTimeManager(boardState* state, timeManager* manager){
+    if((clock != NULL)&&clock->running){
+      int side = state->isWhitesTurn ? 0 : 1;
+      manager->startClocked(clock->remainingMs[side], clock->incrementMs, clock->movesToGo(state->isWhitesTurn));
+    }else{
+      manager->startFixed(moveTimeMs);
+    }
+  }
+
+  //from any thread, getBestMove returns the best move of the last finished iteration soon after
+  void
+  stop(void){
+    shared.stop = true;
+  }
+
+  void
+  resetSearchData(void){
+    info_depth = 0;
+    info_nodes = 0;
+    info_time = 0;
+    info_nps = 0;
+    info_score = 0;
+    info_score_mate = false;
+    info_hashfull = 0;
+    numPvMoves = 0;
+    numPvLines = 0;
+  }
+
+  //mate scores go out as moves to mate like uci, not plies
+  static int
+  uciScore(int score, bool* isMate){
+    *isMate = (abs(score) >= mateThreshold);
+    if(*isMate){
+      return (score > 0) ? ((mateScore-score+1)/2) : -((mateScore+score+1)/2);
+    }
+    return score;
+  }
+
+  void
+  publishInfo(searchWorker* worker, long long nodes, bool print){
+    long long elapsed = clockNowMs()-shared.startMs;
+    info_depth = worker->completedDepth;
+    info_nodes = nodes;
+    info_time = elapsed;
+    info_nps = (elapsed > 0) ? (nodes*1000/elapsed) : 0;
+    info_hashfull = shared.table.hashfull();
+    for(int line = 0; line < worker->numLines; line++){
+      rootLine* found = &worker->lines[line];
+      info_line_score[line] = uciScore(found->score, &info_line_score_mate[line]);
+      numLinePvMoves[line] = 0;
+      for(int i = 0; i < found->length; i++){
+	char text[6];
+	moveToString(found->moves[i], text);
+	memcpy(info_line_pv[line][numLinePvMoves[line]++], text, 5);
+      }
+    }
+    numPvLines = worker->numLines;
+    if(numPvLines > 0){
+      info_score = info_line_score[0];
+      info_score_mate = info_line_score_mate[0];
+      numPvMoves = numLinePvMoves[0];
+      memcpy(info_pv, info_line_pv[0], sizeof(info_pv));
+    }
+    if(print){
+      for(int line = 0; line < numPvLines; line++){
+	printf("info depth %d", info_depth);
+	if(numPvLines > 1){
+	  printf(" multipv %d", line+1);
+	}
+	printf(" score %s %d nodes %lld nps %d hashfull %d time %d pv", info_line_score_mate[line] ? "mate" : "cp", info_line_score[line], info_nodes, info_nps, info_hashfull, info_time);
+	for(int i = 0; i < numLinePvMoves[line]; i++){
+	  printf(" %.5s", info_line_pv[line][i]);
+	}
+	printf("\n");
+      }
+    }
+  }
+
+  move
+  getBestMove(boardState* state){
+    TRACE_SPAN("searchEngine::getBestMove");
+    move bestMove;
+    if(ponderThread.joinable()&&(state->key == ponderState.key)){
+      //ponder hit, the time already spent pondering counts toward the soft budget, the hard one starts now
+      timeManager atHit;
+      startTimeManager(state, &atHit);
+      long long now = clockNowMs();
+      if((atHit.softMs > 0)&&(now-shared.startMs >= atHit.softMs)){
+	shared.stop = true;//pondered long enough already, the last finished iteration is the move
+      }
+      shared.startMs = now;
+      shared.moveTimeMs = atHit.hardMs;
+      shared.pondering = false;
+      if(verbose){
+	printf("info string ponderhit\n");
+      }
+      ponderThread.join();
+      bestMove = ponderResult;
+    }else{
+      stopPondering();
+      bestMove = search(state, false);
+    }
+    if(verbose){
+      char text[6];
+      moveToString(bestMove, text);
+      printf("bestmove %s\n", text);
+    }
+    return bestMove;
+  }
+
+  //a ponder search runs until stopped or until getBestMove turns it into a normal one with a ponder hit
+  move
+  search(boardState* state, bool ponder){
+    resetSearchData();
+    std::vector<move> rootMoves = chessGame::generateLegalMoves(state);
+    if(rootMoves.size() == 0){
+      printf("search asked for a move with none legal\n");
+      exit(1);
+    }
+    //ponder sets these before the thread starts, so a miss straight away still stops it
+    if(!ponder){
+      shared.stop = false;
+      shared.startMs = clockNowMs();
+      startTimeManager(state, &time);
+      shared.moveTimeMs = time.hardMs;
+    }
+    shared.nodes = 0;
+    shared.maxNodes = maxNodes;
+    shared.multiPv = std::max(1, std::min(multiPv, maxMultiPv));
+    shared.table.newSearch();
+    while((int)workers.size() < std::max(numThreads, 1)){
+      workers.push_back(new searchWorker(workers.size(), &shared));
+    }
+    int usedThreads = std::max(numThreads, 1);
+    for(int i = 0; i < usedThreads; i++){
+      workers[i]->reset();
+    }
+    std::vector<std::thread> helpers;
+    for(int i = 1; i < usedThreads; i++){
+      helpers.push_back(std::thread(&searchWorker::helperLoop, workers[i], *state, maxDepth));
+    }
+
+    searchWorker* mainWorker = workers[0];
+    long long searchStartMs = shared.startMs;
+    for(int depth = 1; depth <= maxDepth; depth++){
+      if(!mainWorker->searchRoot(state, depth)){
+	break;//a partial iteration can't be trusted, keep the last full one
+      }
+      publishInfo(mainWorker, shared.nodes + (mainWorker->nodes & 1023), verbose);
+      if(abs(mainWorker->completedScore) >= mateThreshold){
+	break;
+      }
+      bool pastBudget = time.iterationDone(mainWorker->previousPv[0], mainWorker->completedScore, clockNowMs()-shared.startMs);
+      if(ponder){
+	if(shared.pondering){
+	  continue;
+	}
+	//first iteration since the hit, pondering counts as time spent
+	ponder = false;
+	startTimeManager(state, &time);
+	pastBudget = time.iterationDone(mainWorker->previousPv[0], mainWorker->completedScore, clockNowMs()-searchStartMs);
+      }
+      if(pastBudget){
+	break;
+      }
+    }
+    shared.stop = true;
+    for(int i = 0; i < (int)helpers.size(); i++){
+      helpers[i].join();
+    }
+
+    //deepest finished iteration wins, main thread on ties unless a helper found more
+    searchWorker* best = mainWorker;
+    long long totalNodes = 0;
+    for(int i = 0; i < usedThreads; i++){
+      searchWorker* worker = workers[i];
+      totalNodes += worker->nodes;
+      if((worker->previousPvLength > 0)&&((worker->completedDepth > best->completedDepth)||((worker->completedDepth == best->completedDepth)&&(worker->completedScore > best->completedScore)))){
+	best = worker;
+      }
+    }
+    move bestMove = rootMoves[0];
+    if(best->previousPvLength > 0){
+      bestMove = best->previousPv[0];
+    }
+    expectedReply = (best->previousPvLength > 1) ? best->previousPv[1] : move();
+    publishInfo(best, totalNodes, verbose&&(best != mainWorker));
+    bestmove_depth = info_depth;
+    bestmove_score = info_score;
+    bestmove_score_mate = info_score_mate;
+    bestmove_numPvLines = numPvLines;
+    if(verbose){
+      double seconds = std::max(clockNowMs()-shared.startMs, 1LL)*1e-3;
+      for(int i = 0; i < usedThreads; i++){
+	printf("info string thread %d nodes %lld nps %.0f depth %d pawn hash hits %.1f%%\n", i, workers[i]->nodes, workers[i]->nodes/seconds, workers[i]->completedDepth, workers[i]->pawns.hitRate());
+      }
+      printf("info string %d threads nodes %lld nps %.0f\n", usedThreads, totalNodes, totalNodes/seconds);
+      printf("info string hash %llu MB on %s, zeroed in %lld ms\n", (unsigned long long)(shared.table.memory.size >> 20), shared.table.memory.backing, shared.table.memory.prefaultMs);
+    }
+    resetSearchData();
+    return bestMove;
+  }
+};
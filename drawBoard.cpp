@@ -362,6 +362,7 @@ initGLStuff(void)
     assert(false);
   }
   printf("GLFW and GLEW init done\n");
+  startupMark(startupMilestone_windowCreated);
 }
 
 void
@@ -374,16 +375,52 @@ closeGLFW(void)
 void
 glfwLoopStuff(double input_timeout)
 {
+  TRACE_SPAN("glfwLoopStuff");
   glfwSwapBuffers(mainWindow);
+  startupMark(startupMilestone_firstFrame);
   glfwWaitEventsTimeout(input_timeout);//so only continues when cursor moves and stuff
   //glfwPollEvents();//basically timeout 0
 }
 
+static unsigned char* piecesData = NULL;
+static int piecesWidth, piecesHeight, piecesChannels;
+static std::thread piecesDecodeThread;
+
+static void
+decodePieces(void)
+{
+  piecesData = stbi_load("pieces.png", &piecesWidth, &piecesHeight, &piecesChannels, 0);
+  startupMark(startupMilestone_textureDecoded);
+}
+
+//the png decode doesn't need the gl context so it can run while the window and engines are starting
+void
+startDecodingPieces(void)
+{
+  piecesDecodeThread = std::thread(decodePieces);
+}
+
+//for returning before there's a window, a thread still joinable at exit would abort the process
+void
+finishDecodingPieces(void)
+{
+  if(piecesDecodeThread.joinable()){
+    piecesDecodeThread.join();
+  }
+}
+
 void
 loadChessPieceTexture(void)
 {
-  int width, height, nrChannels;
-  unsigned char *data = stbi_load("pieces.png", &width, &height, &nrChannels, 0);
+  if(piecesDecodeThread.joinable()){
+    piecesDecodeThread.join();
+  }else{
+    decodePieces();
+  }
+  int width = piecesWidth;
+  int height = piecesHeight;
+  int nrChannels = piecesChannels;
+  unsigned char *data = piecesData;
   printf("w h c = %d, %d, %d\n", width, height, nrChannels);
   if(data == NULL){
     printf("chess pieces texture failed to load\n");
@@ -451,6 +488,7 @@ setupOpenGLStuff(void)
   enableTransparency();
   
   printf("openGl ready\n");
+  startupMark(startupMilestone_glReady);
 }
 
 
@@ -489,23 +527,26 @@ pieceToEnum(char piece){
 
   default:
     assert(false);
+    return -1;
   }
 }
 
+//engine and searchEngine both keep their current line as uci move strings
 void
-drawEngineInfo(engine* engineToDraw){
-  for(int i = 0; i < engineToDraw->numPvMoves; i++){
-    int x0 = engineToDraw->info_pv[i][0] - 'a';
-    int y0 = engineToDraw->info_pv[i][1] - '1';
-    int x1 = engineToDraw->info_pv[i][2] - 'a';
-    int y1 = engineToDraw->info_pv[i][3] - '1';
-    drawThickLine(-1, glm::vec3((x0+0.5)/8.0, (y0+0.5)/8.0, 0), glm::vec3((x1+0.5)/8.0, (y1+0.5)/8, 0), 0.002);
+drawPv(int numPvMoves, char pvMoves[][5], double width = 0.002){
+  for(int i = 0; i < numPvMoves; i++){
+    int x0 = pvMoves[i][0] - 'a';
+    int y0 = pvMoves[i][1] - '1';
+    int x1 = pvMoves[i][2] - 'a';
+    int y1 = pvMoves[i][3] - '1';
+    drawThickLine(-1, glm::vec3((x0+0.5)/8.0, (y0+0.5)/8.0, 0), glm::vec3((x1+0.5)/8.0, (y1+0.5)/8, 0), width);
   }
 }
 
 void
 openGLDrawStuff(void)
 {
+  TRACE_SPAN("openGLDrawStuff");
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   
   glm::mat4 viewMatrix = glm::mat4(1);
@@ -535,8 +576,22 @@ openGLDrawStuff(void)
     }
   }
   
-  drawEngineInfo(&g.engine1);
-  drawEngineInfo(&g.engine2);
+  if(g.engine1 != NULL){
+    drawPv(g.engine1->numPvMoves, g.engine1->info_pv);
+  }
+  if(g.engine2 != NULL){
+    drawPv(g.engine2->numPvMoves, g.engine2->info_pv);
+  }
+  //multipv lines after the first are drawn thinner
+  searchEngine* searches[2] = {g.search1, g.search2};
+  for(int s = 0; s < 2; s++){
+    if(searches[s] != NULL){
+      drawPv(searches[s]->numPvMoves, searches[s]->info_pv);
+      for(int line = 1; line < searches[s]->numPvLines; line++){
+	drawPv(searches[s]->numLinePvMoves[line], searches[s]->info_line_pv[line], 0.001);
+      }
+    }
+  }
 
   //drawThickLine(-1, glm::vec3(0, 0, 0), glm::vec3(1, 1, 1), 0.1);
 }
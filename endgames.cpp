@@ -0,0 +1,274 @@
+//endgames the built in search knows the answer to, found by boardState's material signature
+//KXK and KBNK drive the bare king to an edge or the right corner, KPK looks the result up in a bitbase built on first use
+
+#include <mutex>
+
+//won but no mate found yet, well clear of mateThreshold so it never reads as a mate
+const int knownWinScore = 10000;
+
+int
+squareDistance(int a, int b){
+  return std::max(abs(a%8 - b%8), abs(a/8 - b/8));
+}
+
+//0 in the centre up to 6 in a corner
+int
+edgeCloseness(int pos){
+  int x = pos%8;
+  int y = pos/8;
+  return std::max(3-x, x-4) + std::max(3-y, y-4);
+}
+
+//king and pawn against king, from retrograde analysis over every placement
+//squares here count from a1 = 0 like rank*8 + file, white has the pawn, and the pawn is on files a-d (the rest are mirrored)
+class kpkBitbase {
+public:
+  enum { invalid = 0, unknown = 1, draw = 2, win = 4 };
+  static const int size = 2*24*64*64;//side to move, pawn on a-d 2-7, white king, black king
+  unsigned char results[size];
+
+  static int
+  index(int blackToMove, int blackKing, int whiteKing, int pawn){
+    return blackToMove + 2*(blackKing + 64*(whiteKing + 64*((pawn/8 - 1)*4 + pawn%8)));
+  }
+
+  static bool
+  pawnAttacks(int pawn, int pos){
+    return (pos/8 == pawn/8 + 1)&&(abs(pos%8 - pawn%8) == 1);
+  }
+
+  void
+  build(void){
+    for(int blackToMove = 0; blackToMove < 2; blackToMove++){
+      for(int pawn = 8; pawn < 56; pawn++){
+	if(pawn%8 > 3){
+	  continue;
+	}
+	for(int whiteKing = 0; whiteKing < 64; whiteKing++){
+	  for(int blackKing = 0; blackKing < 64; blackKing++){
+	    results[index(blackToMove, blackKing, whiteKing, pawn)] = classifyStart(blackToMove, blackKing, whiteKing, pawn);
+	  }
+	}
+      }
+    }
+    bool changed = true;
+    while(changed){
+      changed = false;
+      for(int i = 0; i < size; i++){
+	if(results[i] != unknown){
+	  continue;
+	}
+	int blackToMove = i & 1;
+	int blackKing = (i >> 1) & 63;
+	int whiteKing = (i >> 7) & 63;
+	int pawnIndex = i >> 13;
+	int pawn = (pawnIndex/4 + 1)*8 + pawnIndex%4;
+	int result = classify(blackToMove, blackKing, whiteKing, pawn);
+	if(result != unknown){
+	  results[i] = result;
+	  changed = true;
+	}
+      }
+    }
+    for(int i = 0; i < size; i++){
+      if(results[i] == unknown){
+	results[i] = draw;//nobody could force anything
+      }
+    }
+  }
+
+  int
+  classifyStart(int blackToMove, int blackKing, int whiteKing, int pawn){
+    if((whiteKing == blackKing)||(whiteKing == pawn)||(blackKing == pawn)||(squareDistance(whiteKing, blackKing) <= 1)){
+      return invalid;
+    }
+    if((!blackToMove)&&pawnAttacks(pawn, blackKing)){
+      return invalid;//black in check with white to move
+    }
+    int queening = pawn+8;
+    if((!blackToMove)&&(pawn/8 == 6)&&(whiteKing != queening)&&(blackKing != queening)
+       &&((squareDistance(blackKing, queening) > 1)||(squareDistance(whiteKing, queening) == 1))){
+      return win;//promotes and the queen can't be taken
+    }
+    if(blackToMove){
+      bool canMove = false;
+      for(int to = 0; to < 64; to++){
+	if((squareDistance(blackKing, to) != 1)||(squareDistance(whiteKing, to) <= 1)||pawnAttacks(pawn, to)){
+	  continue;
+	}
+	if(to == pawn){
+	  return draw;//pawn taken, and it wasn't defended or the king couldn't have gone there
+	}
+	canMove = true;
+      }
+      if(!canMove){
+	return draw;//stalemate
+      }
+    }
+    return unknown;
+  }
+
+  //white wants a move to a win, black a move to a draw, invalid targets (illegal moves) count for nothing
+  int
+  classify(int blackToMove, int blackKing, int whiteKing, int pawn){
+    int good = blackToMove ? draw : win;
+    int bad = blackToMove ? win : draw;
+    int reachable = invalid;
+    int moving = blackToMove ? blackKing : whiteKing;
+    for(int dy = -1; dy <= 1; dy++){
+      for(int dx = -1; dx <= 1; dx++){
+	int x = moving%8 + dx;
+	int y = moving/8 + dy;
+	if(((dx == 0)&&(dy == 0))||(x < 0)||(x > 7)||(y < 0)||(y > 7)){
+	  continue;
+	}
+	int to = y*8 + x;
+	reachable |= blackToMove ? results[index(0, to, whiteKing, pawn)] : results[index(1, blackKing, to, pawn)];
+      }
+    }
+    if(!blackToMove){
+      if(pawn/8 < 6){
+	reachable |= results[index(1, blackKing, whiteKing, pawn+8)];
+      }
+      if((pawn/8 == 1)&&(pawn+8 != whiteKing)&&(pawn+8 != blackKing)){
+	reachable |= results[index(1, blackKing, whiteKing, pawn+16)];
+      }
+    }
+    if(reachable & good){
+      return good;
+    }
+    return (reachable & unknown) ? unknown : bad;
+  }
+};
+
+kpkBitbase* kpk = NULL;
+std::once_flag kpkBuilt;
+
+//builds the KPK bitbase if nothing has yet, searchEngine calls it when it's made so no timed search waits on it
+void
+prepareEndgames(void){
+  std::call_once(kpkBuilt, [](){
+    kpk = new kpkBitbase();
+    kpk->build();
+  });
+}
+
+//board index (a8 = 0) to the bitbase's a1 = 0 squares, seen from the side with the pawn, pawn on a-d
+int
+kpkSquare(int pos, bool strongIsWhite, bool mirrorFiles){
+  int x = pos%8;
+  int rank = 7 - pos/8;
+  if(!strongIsWhite){
+    rank = 7-rank;
+  }
+  if(mirrorFiles){
+    x = 7-x;
+  }
+  return rank*8 + x;
+}
+
+//the strong side's pieces besides its king, in centipawns
+int
+endgameMaterial(boardState* state, bool isWhite){
+  unsigned long long key = state->materialKey;
+  const char* pieces = isWhite ? "PNBRQ" : "pnbrq";
+  const int values[5] = {100, 320, 330, 500, 900};
+  int total = 0;
+  for(int i = 0; i < 5; i++){
+    total += values[i]*material.count(key, pieces[i]);
+  }
+  return total;
+}
+
+//KPK only, whether the side with the pawn wins, *pawn gets the pawn's board index
+bool
+kpkWins(boardState* state, bool strongIsWhite, int* pawn){
+  prepareEndgames();
+  *pawn = -1;
+  for(int i = 8; i < 56; i++){
+    if(state->isPawn(i)){
+      *pawn = i;
+    }
+  }
+  bool mirrorFiles = (*pawn%8 > 3);
+  int whiteKing = kpkSquare(chessGame::findKing(state, strongIsWhite), strongIsWhite, mirrorFiles);
+  int blackKing = kpkSquare(chessGame::findKing(state, !strongIsWhite), strongIsWhite, mirrorFiles);
+  int p = kpkSquare(*pawn, strongIsWhite, mirrorFiles);
+  bool blackToMove = (state->isWhitesTurn != strongIsWhite);
+  return kpk->results[kpkBitbase::index(blackToMove, blackKing, whiteKing, p)] == kpkBitbase::win;
+}
+
+//dead draws, including drawn KPK, nothing to gain from searching them
+//a won KPK still gets searched so the side with the pawn finds its way to promoting
+bool
+endgameIsExact(boardState* state){
+  if(state->isInsufficientMaterial()){
+    return true;
+  }
+  unsigned long long key = state->materialKey;
+  if((key == 1)||(key == (1ULL << 20))){
+    int pawn;
+    return !kpkWins(state, key == 1, &pawn);
+  }
+  return false;
+}
+
+//true with *score (white's point of view) when the material is one of the endgames known here
+bool
+endgameEvaluate(boardState* state, int* score){
+  unsigned long long key = state->materialKey;
+  if(state->isInsufficientMaterial()){
+    *score = 0;
+    return true;
+  }
+  bool whiteBare = (key & materialWhiteMask) == 0;
+  bool blackBare = (key & materialBlackMask) == 0;
+  if(whiteBare == blackBare){
+    return false;
+  }
+  bool strongIsWhite = blackBare;
+  unsigned long long strong = strongIsWhite ? key : (key >> 20);
+  int strongKing = chessGame::findKing(state, strongIsWhite);
+  int weakKing = chessGame::findKing(state, !strongIsWhite);
+  int sign = strongIsWhite ? 1 : -1;
+  int pawns = strong & 15;
+  int knights = (strong >> 4) & 15;
+  int bishops = (strong >> 8) & 15;
+  int rooks = (strong >> 12) & 15;
+  int queens = (strong >> 16) & 15;
+
+  //KPK, exact win or draw
+  if(strong == 1){
+    int pawn;
+    if(!kpkWins(state, strongIsWhite, &pawn)){
+      *score = 0;
+      return true;
+    }
+    //every won position ties on the bitbase alone, so reward the pawn coming up with its king beside it and the other king away
+    int rank = strongIsWhite ? (7 - pawn/8) : pawn/8;
+    *score = sign*(knownWinScore + 100 + 20*rank + 5*(7-squareDistance(strongKing, pawn)) + 5*squareDistance(weakKing, pawn));
+    return true;
+  }
+
+  //KBNK, the bare king has to be mated in a corner the bishop covers
+  if(strong == ((1ULL << 4) | (1ULL << 8))){
+    int bishop = __builtin_ctzll(state->bishops[strongIsWhite ? 0 : 1]);
+    //a8 and h1 are light, a1 and h8 dark
+    bool lightBishop = (((bishop%8)+(bishop/8)) & 1) == 0;
+    int corner = lightBishop ? std::min(squareDistance(weakKing, 0), squareDistance(weakKing, 63)) : std::min(squareDistance(weakKing, 7), squareDistance(weakKing, 56));
+    *score = sign*(knownWinScore + endgameMaterial(state, strongIsWhite) + 20*(7-corner) + 10*(7-squareDistance(strongKing, weakKing)));
+    return true;
+  }
+
+  //KXK, enough to mate a bare king, push it to the edge and bring the other king up
+  if(endgameMaterial(state, strongIsWhite) - 100*pawns >= 500){
+    bool canMate = (queens > 0)||(rooks > 0)||((bishops > 0)&&(knights > 0))||(bishops > 1);
+    int result = endgameMaterial(state, strongIsWhite) + 20*edgeCloseness(weakKing) + 10*(7-squareDistance(strongKing, weakKing));
+    if(canMate){
+      result += knownWinScore;
+    }
+    *score = sign*result;
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,105 @@
+//memory for the big tables (the transposition table), on 2 MB pages when the system has them
+//a multi gigabyte table on 4 KB pages misses the TLB on nearly every probe, huge pages cut that by 512x
+
+#include <sys/mman.h>
+
+#include <thread>
+#include <vector>
+
+const size_t hugePageSize = 2*1024*1024;
+
+//transparent huge pages are only worth asking for when the kernel isn't set to never
+bool
+transparentHugePagesEnabled(void){
+  FILE* file = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+  if(file == NULL){
+    return false;
+  }
+  char line[128] = "";
+  if(fgets(line, sizeof(line), file) == NULL){
+    line[0] = '\0';
+  }
+  fclose(file);
+  return (line[0] != '\0')&&(strstr(line, "[never]") == NULL);
+}
+
+class largeBuffer {
+public:
+  void* memory = NULL;
+  size_t size = 0;
+  bool mapped = false;//from mmap, otherwise aligned_alloc
+  const char* backing = "nothing";
+  long long prefaultMs = 0;
+
+  ~largeBuffer(void){
+    release();
+  }
+
+  //explicit huge pages (needs vm.nr_hugepages set aside), then transparent ones, then whatever malloc gives, NULL only if all fail
+  void*
+  allocate(size_t bytes){
+    release();
+    size = ((bytes + hugePageSize-1)/hugePageSize)*hugePageSize;
+#ifdef MAP_HUGETLB
+    memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(memory != MAP_FAILED){
+      mapped = true;
+      backing = "explicit huge pages";
+      return memory;
+    }
+#endif
+    memory = aligned_alloc(hugePageSize, size);
+    if(memory == NULL){
+      size = 0;
+      backing = "nothing";
+      return NULL;
+    }
+    backing = "normal pages";
+#ifdef MADV_HUGEPAGE
+    if(transparentHugePagesEnabled()&&(madvise(memory, size, MADV_HUGEPAGE) == 0)){
+      backing = "transparent huge pages";
+    }
+#endif
+    return memory;
+  }
+
+  void
+  release(void){
+    if(memory == NULL){
+      return;
+    }
+    if(mapped){
+      munmap(memory, size);
+    }else{
+      free(memory);
+    }
+    memory = NULL;
+    size = 0;
+    mapped = false;
+  }
+
+  //zeroes everything, split over threads so the page faults of a big fresh table are taken in parallel and not by the first search
+  void
+  zero(void){
+    long long startMs = clockNowMs();
+    const size_t minChunk = 64*1024*1024;
+    int numThreads = (int)std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), (size + minChunk-1)/minChunk);
+    if(numThreads <= 1){
+      memset(memory, 0, size);
+    }else{
+      //chunks on page boundaries, so no two threads fault the same page
+      size_t chunk = ((size/numThreads + hugePageSize-1)/hugePageSize)*hugePageSize;
+      std::vector<std::thread> threads;
+      for(size_t start = 0; start < size; start += chunk){
+	size_t length = std::min(chunk, size-start);
+	threads.push_back(std::thread([this, start, length](){
+	  memset((char*)memory + start, 0, length);
+	}));
+      }
+      for(int i = 0; i < (int)threads.size(); i++){
+	threads[i].join();
+      }
+    }
+    prefaultMs = clockNowMs()-startMs;
+  }
+};
@@ -6,11 +6,23 @@
 #include <poll.h>
 #include <ctype.h>
 #include <assert.h>
+#include <time.h>
 
 #include <thread>
 
+#include "startupProfile.cpp"
+#include "perfCounters.cpp"
+#include "allocTracker.cpp"
+#include "trace.cpp"
 #include "chessLogic.cpp"
+#include "timeManager.cpp"
 #include "chessEngine.cpp"
+#include "largePages.cpp"
+#include "transpositionTable.cpp"
+#include "pawnHash.cpp"
+#include "endgames.cpp"
+#include "nnue.cpp"
+#include "chessSearch.cpp"
 
 const int ENUM_undoKeyPressed = 0;
 const int ENUM_redoKeyPressed = 1;
@@ -24,8 +36,17 @@ static const char cmd[] = "./stockfish/stockfish";
 class Globals {
 public:
   chessGame currentGame;
-  engine engine1 = engine(cmd);
-  engine engine2 = engine(cmd);
+  //only started for the sides an engine plays, NULL otherwise
+  engine* engine1 = NULL;
+  engine* engine2 = NULL;
+  const char* enginePath = cmd;
+  //sides played by the in-process search instead of an engine process, NULL otherwise
+  searchEngine* search1 = NULL;
+  searchEngine* search2 = NULL;
+  //both sides' time when play got --clock, every side that isn't human reads it
+  gameClock clock;
+  //native sides keep searching through a human's turn
+  bool ponder = true;
 
   int numPlayers = -1;
   bool whiteIsPlayer;
@@ -67,12 +88,24 @@ restartGame(void)
 {
   g.currentGame = chessGame();
   char newGameCmd[] = "ucinewgame\n";
-  g.engine1.writeToEngine(newGameCmd);
-  g.engine2.writeToEngine(newGameCmd);
+  if(g.engine1 != NULL){
+    g.engine1->writeToEngine(newGameCmd);
+  }
+  if(g.engine2 != NULL){
+    g.engine2->writeToEngine(newGameCmd);
+  }
+  if(g.search1 != NULL){
+    g.search1->newGame();
+  }
+  if(g.search2 != NULL){
+    g.search2->newGame();
+  }
+  g.clock.reset();
 }
 
 void
 handleWinConditions(void){
+  TRACE_SPAN("handleWinConditions");
   std::vector<move> legalMoves = g.currentGame.generateLegalMoves(&g.currentGame.currentState);
   bool isInCheck = g.currentGame.isInCheck(&g.currentGame.currentState, g.currentGame.currentState.isWhitesTurn);
   if((legalMoves.size() == 0)){
@@ -88,7 +121,20 @@ handleWinConditions(void){
     usleep(1000000);
     restartGame();
   }
-  const int fifty_move_rule_max = 50;
+  for(int side = 0; side < 2; side++){
+    if(g.clock.flagged[side]){
+      printf("out of time -- %s wins\n", (side == 0) ? "black" : "white");
+      usleep(1000000);
+      restartGame();
+      return;
+    }
+  }
+  if(g.currentGame.currentState.isInsufficientMaterial()){
+    printf("draw -- insufficient material\n");
+    usleep(1000000);
+    restartGame();
+    return;
+  }
   if(g.currentGame.currentState.halfMoves > fifty_move_rule_max){
     printf("stalemate -- %d moves without pawn advance or capture\n", fifty_move_rule_max);
     usleep(1000000);
@@ -135,8 +181,23 @@ printGame(void){
 void
 doEngineMove(engine* usethis){
   move engineMove = usethis->getBestMove(&g.currentGame.currentState);;
-  bool success = g.currentGame.attemptMove(engineMove);
-  assert(success);
+  if(!g.currentGame.attemptMove(engineMove)){
+    printf("engine played an illegal move\n");
+    exit(1);
+  }
+}
+
+void
+doSearchMove(searchEngine* usethis){
+  move searchMove = usethis->getBestMove(&g.currentGame.currentState);
+  if(!g.currentGame.attemptMove(searchMove)){
+    printf("native search played an illegal move\n");
+    exit(1);
+  }
+  bool opponentIsPlayer = g.currentGame.currentState.isWhitesTurn ? g.whiteIsPlayer : g.blackIsPlayer;
+  if(g.ponder&&opponentIsPlayer){
+    usethis->ponder(&g.currentGame.currentState);
+  }
 }
 
 void
@@ -296,38 +357,68 @@ doPlayerMove(void){
 void
 doMove(void)
 {
+  TRACE_SPAN("doMove");
+  bool whiteMoving = g.currentGame.currentState.isWhitesTurn;
   if(g.currentGame.currentState.isWhitesTurn){
     if(g.whiteIsPlayer){
       doPlayerMove();
+    }else if(g.search1 != NULL){
+      doSearchMove(g.search1);
     }else{
-      doEngineMove(&g.engine1);
+      doEngineMove(g.engine1);
     }
   }else{
     if(g.blackIsPlayer){
       doPlayerMove();
+    }else if(g.search2 != NULL){
+      doSearchMove(g.search2);
     }else{
-      doEngineMove(&g.engine2);
+      doEngineMove(g.engine2);
+    }
+  }
+  //a human's doMove can come back without a move (bad input, undo), their clock keeps going
+  if(g.currentGame.currentState.isWhitesTurn != whiteMoving){
+    g.clock.endTurn(whiteMoving);
+    if(g.clock.running){
+      printf("clock white %.1f black %.1f\n", g.clock.remainingMs[0]*1e-3, g.clock.remainingMs[1]*1e-3);
     }
   }
 }
 
 void
 runGame(void){
+  TRACE_THREAD_NAME("game");
+  ALLOC_SUBSYSTEM(allocSubsystem_gameLoop);
+  g.clock.reset();//white's time starts with the game, not with the window
   while(true){
+#ifdef TRACK_ALLOCATIONS
+    allocSnapshot beforeMove = takeAllocSnapshot();
+#endif
     printGame();
+    bool whiteBefore = g.currentGame.currentState.isWhitesTurn;
     doMove();
+    if(g.currentGame.currentState.isWhitesTurn != whiteBefore){//not for a bad command or an engine that gave up
+      startupMark(startupMilestone_firstMove);
+    }
     handleWinConditions();
+#ifdef TRACK_ALLOCATIONS
+    printf("heap allocations during this move:\n");
+    printAllocationsSince(&beforeMove, 0, NULL);
+#endif
   }
 }
 
 void
 drawLoop(double input_timeout){
-  glfwLoopStuff(input_timeout);
+  //draw before waiting on events, otherwise the first frame only shows up after the first input_timeout
   openGLDrawStuff();
+  glfwLoopStuff(input_timeout);
 }
 
 void
 drawGame(void){//some glfw stuff must be on the same thread or it blows up. idk why but its in the documentation at least, and (i think?) in win32 the polling must be done on the main thread but i don't care about that for now. Some glfw stuff cna be on different threads but just putting it all on on thread hopefully makes that less confusing
+  TRACE_THREAD_NAME("gui");
+  ALLOC_SUBSYSTEM(allocSubsystem_rendering);
   initGLStuff();
   setupOpenGLStuff();
   
@@ -350,6 +441,9 @@ startGame(void){
   //drawGame();
   printf("closing gui\n");
   closeGLFW();
+#ifdef TRACING
+  traceFlush(traceFilename());
+#endif
 
   gameThread.join();
 }
@@ -409,19 +503,346 @@ initialInput(void){
   }
 }
 
+void
+printUsage(void){
+  printf("usage: foo [play] [--white human|engine|native] [--black human|engine|native] [--engine path] [--movetime ms] [--hash MB] [--threads N] [--nnue file] [--disable list] [--multipv N] [--clock [moves/]seconds[+increment]] [--no-ponder]\n");
+  printf("       foo perft [depth] [--fen fen]\n");
+  printf("       foo bench\n");
+  printf("       foo analyse file.epd [--depth N] [--engine path | --native [--movetime ms] [--hash MB] [--threads N] [--nnue file] [--disable list] [--multipv N]]\n");
+  printf("play without --white/--black asks how many players, only play opens a window and only engine sides start an engine\n");
+  printf("native sides and analyse --native use the built in search (chessSearch.cpp) instead of an engine process\n");
+  printf("--clock gives both sides a chess clock, engines get go wtime/btime and the built in search budgets from it, instead of a fixed time or depth a move\n");
+  printf("native sides ponder on the reply they expect while a human thinks, --no-ponder leaves the cpu idle instead\n");
+  printf("--multipv N has the built in search find its best N moves with a line each, analyse adds them as ;multipv k move score\n");
+  printf("--disable nullmove,lmr,futility,checkext (or all) turns off the built in search's pruning and extensions to compare against\n");
+}
+
+bool
+parseSide(const char* value, bool* isPlayer, bool* isNative){
+  *isNative = false;
+  if(strcmp(value, "human") == 0){
+    *isPlayer = true;
+  }else if(strcmp(value, "engine") == 0){
+    *isPlayer = false;
+  }else if(strcmp(value, "native") == 0){
+    *isPlayer = false;
+    *isNative = true;
+  }else{
+    printf("side must be human, engine or native, not \"%s\"\n", value);
+    return false;
+  }
+  return true;
+}
+
 int
-main(int argc, char* argv[])
-{
+playCommand(int argc, char* argv[]){
+  bool sidesGiven = false;
+  bool whiteIsNative = false;
+  bool blackIsNative = false;
+  long long moveTimeMs = 1000;
+  int hashMegabytes = searchEngine::defaultHashMegabytes;
+  int numThreads = searchEngine::defaultSearchThreads();
+  const char* networkFile = NULL;
+  searchOptions options;
+  int multiPv = 1;
+  g.whiteIsPlayer = true;
+  g.blackIsPlayer = false;
+  for(int i = 0; i < argc; i++){
+    bool hasValue = (i+1 < argc);
+    if((strcmp(argv[i], "--white") == 0)&&hasValue){
+      if(!parseSide(argv[++i], &g.whiteIsPlayer, &whiteIsNative)){
+	return 1;
+      }
+      sidesGiven = true;
+    }else if((strcmp(argv[i], "--black") == 0)&&hasValue){
+      if(!parseSide(argv[++i], &g.blackIsPlayer, &blackIsNative)){
+	return 1;
+      }
+      sidesGiven = true;
+    }else if((strcmp(argv[i], "--engine") == 0)&&hasValue){
+      g.enginePath = argv[++i];
+    }else if((strcmp(argv[i], "--movetime") == 0)&&hasValue){
+      moveTimeMs = atoll(argv[++i]);
+    }else if((strcmp(argv[i], "--hash") == 0)&&hasValue){
+      hashMegabytes = atoi(argv[++i]);
+    }else if((strcmp(argv[i], "--threads") == 0)&&hasValue){
+      numThreads = atoi(argv[++i]);
+    }else if((strcmp(argv[i], "--nnue") == 0)&&hasValue){
+      networkFile = argv[++i];
+    }else if((strcmp(argv[i], "--disable") == 0)&&hasValue){
+      if(!options.disable(argv[++i])){
+	return 1;
+      }
+    }else if((strcmp(argv[i], "--multipv") == 0)&&hasValue){
+      multiPv = atoi(argv[++i]);
+    }else if(strcmp(argv[i], "--no-ponder") == 0){
+      g.ponder = false;
+    }else if((strcmp(argv[i], "--clock") == 0)&&hasValue){
+      if(!g.clock.parse(argv[++i])){
+	return 1;
+      }
+    }else{
+      printUsage();
+      return 1;
+    }
+  }
   printf("Starting up============================\n");
-  
-  initialInput();
-   
+  startupMark(startupMilestone_mainEntered);
+  if(!sidesGiven){
+    long long promptStartNs = startupNowNs();
+    initialInput();
+    startupExclude(startupNowNs()-promptStartNs);
+  }
+  startDecodingPieces();
   generateDistanceToEdge();
-  nodeTest(3, boardState());
-  
+  //the engines only get "uci" here, their handshakes finish in the background while the window comes up
+  if(whiteIsNative){
+    g.search1 = new searchEngine();
+    g.search1->moveTimeMs = moveTimeMs;
+    g.search1->setHashSize(hashMegabytes);
+    g.search1->numThreads = numThreads;
+    g.search1->shared.options = options;
+    g.search1->clock = &g.clock;
+    g.search1->multiPv = multiPv;
+    if((networkFile != NULL)&&(!g.search1->loadNetwork(networkFile))){
+      finishDecodingPieces();
+      return 1;
+    }
+  }else if(!g.whiteIsPlayer){
+    g.engine1 = new engine(g.enginePath);
+    g.engine1->clock = &g.clock;
+  }
+  if(blackIsNative){
+    g.search2 = new searchEngine();
+    g.search2->moveTimeMs = moveTimeMs;
+    g.search2->setHashSize(hashMegabytes);
+    g.search2->numThreads = numThreads;
+    g.search2->shared.options = options;
+    g.search2->clock = &g.clock;
+    g.search2->multiPv = multiPv;
+    if((networkFile != NULL)&&(!g.search2->loadNetwork(networkFile))){
+      finishDecodingPieces();
+      return 1;
+    }
+  }else if(!g.blackIsPlayer){
+    g.engine2 = new engine(g.enginePath);
+    g.engine2->clock = &g.clock;
+  }
+  startupMark(startupMilestone_enginesSpawned);
   
   startGame();
   
   printf("All done============================\n");
   return 0;
 }
+
+int
+perftCommand(int argc, char* argv[]){
+  int depth = 3;
+  const char* fen = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+  for(int i = 0; i < argc; i++){
+    if((strcmp(argv[i], "--fen") == 0)&&(i+1 < argc)){
+      fen = argv[++i];
+    }else if(isdigit(argv[i][0])){
+      depth = atoi(argv[i]);
+    }else{
+      printUsage();
+      return 1;
+    }
+  }
+  generateDistanceToEdge();//before the fen, loading it checks for a king left in check
+  boardState state;
+  if(!state.loadFromFen(fen)){
+    printf("bad fen \"%s\"\n", fen);
+    return 1;
+  }
+  long long perftNodes = nodeTest(depth, state);
+  printf("perft depth %d = %lld\n", depth, perftNodes);
+#ifdef PERF_COUNTERS
+  perfCountersReport(perftNodes);
+#endif
+  return 0;
+}
+
+//fixed perft workload, prints nodes/s and fails if any count is off, also what the pgo build of this binary trains on
+int
+benchCommand(int argc, char* argv[]){
+  if(argc != 0){
+    printUsage();
+    return 1;
+  }
+  generateDistanceToEdge();
+  long long totalNodes = 0;
+  double totalSeconds = 0;
+  for(int i = 0; i < numPerftSuite; i++){
+    boardState state;
+    state.loadFromFen(perftSuite[i].fen);
+    timespec start;
+    timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long long nodes = nodeTree(perftSuite[i].depth, state);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec-start.tv_sec) + (end.tv_nsec-start.tv_nsec)*1e-9;
+    printf("%-10s depth %d %10lld nodes %10.0f nodes/s\n", perftSuite[i].name, perftSuite[i].depth, nodes, nodes/seconds);
+    if(nodes != perftSuite[i].expectedNodes){
+      printf("PERFT MISMATCH %s: got %lld expected %d\n", perftSuite[i].name, nodes, perftSuite[i].expectedNodes);
+      return 1;
+    }
+    totalNodes += nodes;
+    totalSeconds += seconds;
+  }
+  printf("total %lld nodes %.0f nodes/s\n", totalNodes, totalNodes/totalSeconds);
+  return 0;
+}
+
+//"<fen> ;bm e2e4 ;depth 20 ;score cp 34" for every fen in the file (anything after a ';' is ignored)
+int
+analyseCommand(int argc, char* argv[]){
+  const char* filename = NULL;
+  int depth = 20;
+  bool native = false;
+  long long moveTimeMs = 1000;//native only, 0 searches to --depth however long that takes
+  int hashMegabytes = searchEngine::defaultHashMegabytes;
+  int numThreads = searchEngine::defaultSearchThreads();
+  const char* networkFile = NULL;
+  searchOptions options;
+  int multiPv = 1;
+  for(int i = 0; i < argc; i++){
+    bool hasValue = (i+1 < argc);
+    if((strcmp(argv[i], "--depth") == 0)&&hasValue){
+      depth = atoi(argv[++i]);
+    }else if((strcmp(argv[i], "--engine") == 0)&&hasValue){
+      g.enginePath = argv[++i];
+    }else if(strcmp(argv[i], "--native") == 0){
+      native = true;
+    }else if((strcmp(argv[i], "--movetime") == 0)&&hasValue){
+      moveTimeMs = atoll(argv[++i]);
+    }else if((strcmp(argv[i], "--hash") == 0)&&hasValue){
+      hashMegabytes = atoi(argv[++i]);
+    }else if((strcmp(argv[i], "--threads") == 0)&&hasValue){
+      numThreads = atoi(argv[++i]);
+    }else if((strcmp(argv[i], "--nnue") == 0)&&hasValue){
+      networkFile = argv[++i];
+    }else if((strcmp(argv[i], "--disable") == 0)&&hasValue){
+      if(!options.disable(argv[++i])){
+	return 1;
+      }
+    }else if((strcmp(argv[i], "--multipv") == 0)&&hasValue){
+      multiPv = atoi(argv[++i]);
+    }else if((filename == NULL)&&((argv[i][0] != '-')||(strcmp(argv[i], "-") == 0))){
+      filename = argv[i];
+    }else{
+      printUsage();
+      return 1;
+    }
+  }
+  if(filename == NULL){
+    printUsage();
+    return 1;
+  }
+  FILE* input = (strcmp(filename, "-") == 0) ? stdin : fopen(filename, "r");
+  if(input == NULL){
+    printf("failed to open \"%s\": %s\n", filename, strerror(errno));
+    return 1;
+  }
+  generateDistanceToEdge();
+  //only the one that's used gets made, an engine process or the search's tables aren't free
+  engine* analyser = NULL;
+  searchEngine* nativeAnalyser = NULL;
+  if(native){
+    nativeAnalyser = new searchEngine();
+    nativeAnalyser->maxDepth = std::min(depth, maxSearchPly-1);
+    nativeAnalyser->moveTimeMs = moveTimeMs;
+    nativeAnalyser->verbose = false;
+    nativeAnalyser->setHashSize(hashMegabytes);
+    nativeAnalyser->numThreads = numThreads;
+    nativeAnalyser->shared.options = options;
+    nativeAnalyser->multiPv = multiPv;
+    if((networkFile != NULL)&&(!nativeAnalyser->loadNetwork(networkFile))){
+      return 1;
+    }
+  }else{
+    analyser = new engine(g.enginePath);
+    analyser->searchDepth = depth;
+    analyser->verbose = false;
+  }
+  int badLines = 0;
+  char* line = NULL;
+  size_t capacity = 0;
+  while(getline(&line, &capacity, input) != -1){
+    char* end = strchr(line, ';');
+    int length = (end != NULL) ? end-line : strlen(line);
+    while((length > 0)&&isspace(line[length-1])){
+      length--;
+    }
+    line[length] = '\0';
+    if((length == 0)||(line[0] == '#')){
+      continue;
+    }
+    boardState state;
+    if(!state.loadFromFen(line)){
+      fprintf(stderr, "bad position \"%s\"\n", line);
+      badLines++;
+      continue;
+    }
+    if(chessGame::generateLegalMoves(&state).size() == 0){
+      printf("%s ;%s\n", line, chessGame::isInCheck(&state, state.isWhitesTurn) ? "checkmate" : "stalemate");
+      continue;
+    }
+    move best;
+    int bestDepth;
+    int bestScore;
+    bool bestScoreMate;
+    if(native){
+      best = nativeAnalyser->getBestMove(&state);
+      bestDepth = nativeAnalyser->bestmove_depth;
+      bestScore = nativeAnalyser->bestmove_score;
+      bestScoreMate = nativeAnalyser->bestmove_score_mate;
+    }else{
+      best = analyser->getBestMove(&state);
+      bestDepth = analyser->bestmove_depth;
+      bestScore = analyser->bestmove_score;
+      bestScoreMate = analyser->bestmove_score_mate;
+    }
+    printf("%s ;bm %c%c%c%c", line, 'a'+(best.from%8), '8'-(best.from/8), 'a'+(best.to%8), '8'-(best.to/8));
+    if(best.promotion != '\0'){
+      printf("%c", best.promotion);
+    }
+    printf(" ;depth %d ;score %s %d", bestDepth, bestScoreMate ? "mate" : "cp", bestScore);
+    if(native){
+      for(int k = 1; k < nativeAnalyser->bestmove_numPvLines; k++){
+	printf(" ;multipv %d %.5s %s %d", k+1, nativeAnalyser->info_line_pv[k][0], nativeAnalyser->info_line_score_mate[k] ? "mate" : "cp", nativeAnalyser->info_line_score[k]);
+      }
+    }
+    printf("\n");
+    fflush(stdout);
+  }
+  free(line);
+  if(input != stdin){
+    fclose(input);
+  }
+  return (badLines == 0) ? 0 : 1;
+}
+
+int
+main(int argc, char* argv[])
+{
+  //no subcommand (or only flags) is play, like it always was
+  const char* command = "play";
+  int first = 1;
+  if((argc > 1)&&(argv[1][0] != '-')){
+    command = argv[1];
+    first = 2;
+  }
+  if(strcmp(command, "play") == 0){
+    return playCommand(argc-first, &argv[first]);
+  }else if(strcmp(command, "perft") == 0){
+    return perftCommand(argc-first, &argv[first]);
+  }else if(strcmp(command, "bench") == 0){
+    return benchCommand(argc-first, &argv[first]);
+  }else if((strcmp(command, "analyse") == 0)||(strcmp(command, "analyze") == 0)){
+    return analyseCommand(argc-first, &argv[first]);
+  }
+  printUsage();
+  return 1;
+}
@@ -0,0 +1,455 @@
+//small nnue style evaluation for the native search: king bucketed piece-square inputs into an int16 accumulator per side, then int8 layers
+//the accumulators only get the rows of the squares a move changed added/subtracted, a full refresh only when a king changes bucket
+//
+//weight file, little endian, mmap'd as is so every section starts on a 64 byte boundary:
+//  "SUCNNUE1", int32 features, hidden, l2, l3 (have to match the constants below)
+//  int16 featureBias[hidden], int16 featureWeights[features][hidden]
+//  int32 l2Bias[l2], int8 l2Weights[l2][2*hidden]
+//  int32 l3Bias[l3], int8 l3Weights[l3][l2]
+//  int32 outputBias, int8 outputWeights[l3]
+//activations are clamp(x, 0, 127), hidden layer sums are shifted right by nnueHiddenShift first,
+//the output divided by nnueOutputDivisor is centipawns for the side to move
+
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NNUE_SIMD
+#endif
+
+const int nnueKingBuckets = 4;
+const int nnueFeatures = nnueKingBuckets*768;
+const int nnueHidden = 256;
+const int nnueL2 = 32;
+const int nnueL3 = 32;
+const int nnueHiddenShift = 6;
+const int nnueOutputDivisor = 16;
+//whatever the net says stays inside int16 (the table's score field) and under the native search's mate scores
+const int nnueMaxEval = 30000;
+
+enum {
+  nnueSimd_scalar,
+  nnueSimd_sse41,
+  nnueSimd_avx2,
+  numNnueSimdLevels
+};
+
+const char* nnueSimdNames[numNnueSimdLevels] = {"scalar", "sse4.1", "avx2"};
+
+int
+nnueBestSimdLevel(void){
+#ifdef NNUE_SIMD
+  if(__builtin_cpu_supports("avx2")){
+    return nnueSimd_avx2;
+  }
+  if(__builtin_cpu_supports("sse4.1")){
+    return nnueSimd_sse41;
+  }
+#endif
+  return nnueSimd_scalar;
+}
+
+//which kernels run, bench --check-nnue switches it to compare them
+int nnueSimdLevel = nnueBestSimdLevel();
+
+//each side sees the board from its own end (its back rank is rank 0) so both halves of the network share one shape
+int
+nnueOrient(int pos, int perspective){
+  return (perspective == 0) ? (pos ^ 56) : pos;
+}
+
+int
+nnueKingBucket(boardState* state, int perspective){
+  int king = nnueOrient(chessGame::findKing(state, perspective == 0), perspective);
+  return ((king/8 >= 2) ? 2 : 0) + ((king%8 >= 4) ? 1 : 0);
+}
+
+int
+nnueFeature(int perspective, int bucket, UInt8 piece, int pos){
+  int type = 0;
+  switch(tolower(piece)){
+  case BP: type = 0; break;
+  case BN: type = 1; break;
+  case BB: type = 2; break;
+  case BR: type = 3; break;
+  case BQ: type = 4; break;
+  case BK: type = 5; break;
+  }
+  bool own = (isupper(piece) != 0) == (perspective == 0);
+  return bucket*768 + ((own ? 0 : 6) + type)*64 + nnueOrient(pos, perspective);
+}
+
+class alignas(64) nnueAccumulator {
+public:
+  int16_t values[2][nnueHidden];//[perspective], 0 is white
+  int kingBucket[2];
+};
+
+class nnueNetwork {
+public:
+  void* mapping = MAP_FAILED;
+  size_t mappingSize = 0;
+  const int16_t* featureBias;
+  const int16_t* featureWeights;
+  const int32_t* l2Bias;
+  const int8_t* l2Weights;
+  const int32_t* l3Bias;
+  const int8_t* l3Weights;
+  const int32_t* outputBias;
+  const int8_t* outputWeights;
+
+  ~nnueNetwork(void){
+    if(mapping != MAP_FAILED){
+      munmap(mapping, mappingSize);
+    }
+  }
+
+  static size_t
+  section(size_t bytes){
+    return (bytes+63) & ~(size_t)63;
+  }
+
+  //offsets[i] is where section i starts, offsets[8] is the file size
+  static void
+  layout(size_t offsets[9]){
+    size_t sizes[8] = {
+      nnueHidden*sizeof(int16_t), (size_t)nnueFeatures*nnueHidden*sizeof(int16_t),
+      nnueL2*sizeof(int32_t), nnueL2*2*nnueHidden*sizeof(int8_t),
+      nnueL3*sizeof(int32_t), nnueL3*nnueL2*sizeof(int8_t),
+      sizeof(int32_t), nnueL3*sizeof(int8_t),
+    };
+    offsets[0] = 64;//header
+    for(int i = 0; i < 8; i++){
+      offsets[i+1] = offsets[i] + section(sizes[i]);
+    }
+  }
+
+  bool
+  load(const char* path){
+    size_t offsets[9];
+    layout(offsets);
+    int fd = open(path, O_RDONLY);
+    if(fd < 0){
+      printf("failed to open network \"%s\": %s\n", path, strerror(errno));
+      return false;
+    }
+    struct stat info;
+    if((fstat(fd, &info) != 0)||((size_t)info.st_size != offsets[8])){
+      printf("network \"%s\" is %lld bytes, expected %zu\n", path, (long long)info.st_size, offsets[8]);
+      close(fd);
+      return false;
+    }
+    mapping = mmap(NULL, offsets[8], PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED){
+      printf("failed to mmap network \"%s\": %s\n", path, strerror(errno));
+      return false;
+    }
+    mappingSize = offsets[8];
+    const char* base = (const char*)mapping;
+    const int32_t* dims = (const int32_t*)(base+8);
+    if((memcmp(base, "SUCNNUE1", 8) != 0)||(dims[0] != nnueFeatures)||(dims[1] != nnueHidden)||(dims[2] != nnueL2)||(dims[3] != nnueL3)){
+      printf("network \"%s\" isn't a %dx%d-%d-%d-1 SUCNNUE1 file\n", path, nnueFeatures, nnueHidden, nnueL2, nnueL3);
+      return false;
+    }
+    madvise(mapping, mappingSize, MADV_WILLNEED);
+    featureBias = (const int16_t*)(base+offsets[0]);
+    featureWeights = (const int16_t*)(base+offsets[1]);
+    l2Bias = (const int32_t*)(base+offsets[2]);
+    l2Weights = (const int8_t*)(base+offsets[3]);
+    l3Bias = (const int32_t*)(base+offsets[4]);
+    l3Weights = (const int8_t*)(base+offsets[5]);
+    outputBias = (const int32_t*)(base+offsets[6]);
+    outputWeights = (const int8_t*)(base+offsets[7]);
+    return true;
+  }
+
+  const int16_t*
+  featureRow(int feature){
+    return featureWeights + (size_t)feature*nnueHidden;
+  }
+};
+
+//out = in + every add row - every sub row, int16 wrapping the same way in every kernel
+void
+nnueApplyScalar(const int16_t* in, int16_t* out, const int16_t** adds, int numAdds, const int16_t** subs, int numSubs){
+  for(int i = 0; i < nnueHidden; i++){
+    int v = in[i];
+    for(int a = 0; a < numAdds; a++){
+      v += adds[a][i];
+    }
+    for(int s = 0; s < numSubs; s++){
+      v -= subs[s][i];
+    }
+    out[i] = (int16_t)v;
+  }
+}
+
+void
+nnueClampScalar(const int16_t* in, uint8_t* out){
+  for(int i = 0; i < nnueHidden; i++){
+    out[i] = (in[i] < 0) ? 0 : ((in[i] > 127) ? 127 : in[i]);
+  }
+}
+
+int
+nnueDotScalar(const uint8_t* in, const int8_t* weights, int n){
+  int sum = 0;
+  for(int i = 0; i < n; i++){
+    sum += in[i]*weights[i];
+  }
+  return sum;
+}
+
+#ifdef NNUE_SIMD
+
+__attribute__((target("sse4.1"))) void
+nnueApplySse41(const int16_t* in, int16_t* out, const int16_t** adds, int numAdds, const int16_t** subs, int numSubs){
+  for(int i = 0; i < nnueHidden; i += 8){
+    __m128i v = _mm_loadu_si128((const __m128i*)(in+i));
+    for(int a = 0; a < numAdds; a++){
+      v = _mm_add_epi16(v, _mm_loadu_si128((const __m128i*)(adds[a]+i)));
+    }
+    for(int s = 0; s < numSubs; s++){
+      v = _mm_sub_epi16(v, _mm_loadu_si128((const __m128i*)(subs[s]+i)));
+    }
+    _mm_storeu_si128((__m128i*)(out+i), v);
+  }
+}
+
+__attribute__((target("sse4.1"))) void
+nnueClampSse41(const int16_t* in, uint8_t* out){
+  for(int i = 0; i < nnueHidden; i += 16){
+    __m128i packed = _mm_packs_epi16(_mm_loadu_si128((const __m128i*)(in+i)), _mm_loadu_si128((const __m128i*)(in+i+8)));
+    _mm_storeu_si128((__m128i*)(out+i), _mm_max_epi8(packed, _mm_setzero_si128()));
+  }
+}
+
+//inputs are at most 127 so maddubs's pairwise int16 sums can't saturate
+__attribute__((target("sse4.1"))) int
+nnueDotSse41(const uint8_t* in, const int8_t* weights, int n){
+  __m128i sum = _mm_setzero_si128();
+  __m128i ones = _mm_set1_epi16(1);
+  for(int i = 0; i < n; i += 16){
+    __m128i products = _mm_maddubs_epi16(_mm_loadu_si128((const __m128i*)(in+i)), _mm_loadu_si128((const __m128i*)(weights+i)));
+    sum = _mm_add_epi32(sum, _mm_madd_epi16(products, ones));
+  }
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+  return _mm_cvtsi128_si32(sum);
+}
+
+__attribute__((target("avx2"))) void
+nnueApplyAvx2(const int16_t* in, int16_t* out, const int16_t** adds, int numAdds, const int16_t** subs, int numSubs){
+  for(int i = 0; i < nnueHidden; i += 16){
+    __m256i v = _mm256_loadu_si256((const __m256i*)(in+i));
+    for(int a = 0; a < numAdds; a++){
+      v = _mm256_add_epi16(v, _mm256_loadu_si256((const __m256i*)(adds[a]+i)));
+    }
+    for(int s = 0; s < numSubs; s++){
+      v = _mm256_sub_epi16(v, _mm256_loadu_si256((const __m256i*)(subs[s]+i)));
+    }
+    _mm256_storeu_si256((__m256i*)(out+i), v);
+  }
+}
+
+__attribute__((target("avx2"))) void
+nnueClampAvx2(const int16_t* in, uint8_t* out){
+  for(int i = 0; i < nnueHidden; i += 32){
+    __m256i packed = _mm256_packs_epi16(_mm256_loadu_si256((const __m256i*)(in+i)), _mm256_loadu_si256((const __m256i*)(in+i+16)));
+    packed = _mm256_permute4x64_epi64(packed, 0xD8);//packs works per 128 bit lane, put the halves back in order
+    _mm256_storeu_si256((__m256i*)(out+i), _mm256_max_epi8(packed, _mm256_setzero_si256()));
+  }
+}
+
+__attribute__((target("avx2"))) int
+nnueDotAvx2(const uint8_t* in, const int8_t* weights, int n){
+  __m256i sum = _mm256_setzero_si256();
+  __m256i ones = _mm256_set1_epi16(1);
+  for(int i = 0; i < n; i += 32){
+    __m256i products = _mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i*)(in+i)), _mm256_loadu_si256((const __m256i*)(weights+i)));
+    sum = _mm256_add_epi32(sum, _mm256_madd_epi16(products, ones));
+  }
+  __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+  half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4E));
+  half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xB1));
+  return _mm_cvtsi128_si32(half);
+}
+
+#endif
+
+void
+nnueApply(const int16_t* in, int16_t* out, const int16_t** adds, int numAdds, const int16_t** subs, int numSubs){
+#ifdef NNUE_SIMD
+  if(nnueSimdLevel == nnueSimd_avx2){
+    nnueApplyAvx2(in, out, adds, numAdds, subs, numSubs);
+    return;
+  }
+  if(nnueSimdLevel == nnueSimd_sse41){
+    nnueApplySse41(in, out, adds, numAdds, subs, numSubs);
+    return;
+  }
+#endif
+  nnueApplyScalar(in, out, adds, numAdds, subs, numSubs);
+}
+
+void
+nnueClamp(const int16_t* in, uint8_t* out){
+#ifdef NNUE_SIMD
+  if(nnueSimdLevel == nnueSimd_avx2){
+    nnueClampAvx2(in, out);
+    return;
+  }
+  if(nnueSimdLevel == nnueSimd_sse41){
+    nnueClampSse41(in, out);
+    return;
+  }
+#endif
+  nnueClampScalar(in, out);
+}
+
+//n has to be a multiple of 32
+int
+nnueDot(const uint8_t* in, const int8_t* weights, int n){
+#ifdef NNUE_SIMD
+  if(nnueSimdLevel == nnueSimd_avx2){
+    return nnueDotAvx2(in, weights, n);
+  }
+  if(nnueSimdLevel == nnueSimd_sse41){
+    return nnueDotSse41(in, weights, n);
+  }
+#endif
+  return nnueDotScalar(in, weights, n);
+}
+
+void
+nnueRefresh(nnueNetwork* net, boardState* state, nnueAccumulator* acc, int perspective){
+  int bucket = nnueKingBucket(state, perspective);
+  acc->kingBucket[perspective] = bucket;
+  const int16_t* adds[64];
+  int numAdds = 0;
+  for(int i = 0; i < 64; i++){
+    if(state->board[i] != EMPTY){
+      adds[numAdds++] = net->featureRow(nnueFeature(perspective, bucket, state->board[i], i));
+    }
+  }
+  nnueApply(net->featureBias, acc->values[perspective], adds, numAdds, NULL, 0);
+}
+
+void
+nnueRefreshBoth(nnueNetwork* net, boardState* state, nnueAccumulator* acc){
+  nnueRefresh(net, state, acc, 0);
+  nnueRefresh(net, state, acc, 1);
+}
+
+//child's accumulator from its parent's, only the squares whose contents differ (at most 4, castling) touch the weights
+void
+nnueUpdate(nnueNetwork* net, boardState* parent, nnueAccumulator* parentAcc, boardState* child, nnueAccumulator* childAcc){
+  int changed[8];
+  int numChanged = 0;
+  for(int w = 0; w < 8; w++){
+    uint64_t a, b;
+    memcpy(&a, parent->board+(w*8), 8);
+    memcpy(&b, child->board+(w*8), 8);
+    if(a == b){
+      continue;
+    }
+    for(int i = w*8; i < (w+1)*8; i++){
+      if((parent->board[i] != child->board[i])&&(numChanged < 8)){
+	changed[numChanged++] = i;
+      }
+    }
+  }
+  for(int p = 0; p < 2; p++){
+    int bucket = nnueKingBucket(child, p);
+    if(bucket != parentAcc->kingBucket[p]){
+      nnueRefresh(net, child, childAcc, p);
+      continue;
+    }
+    childAcc->kingBucket[p] = bucket;
+    const int16_t* adds[8];
+    const int16_t* subs[8];
+    int numAdds = 0;
+    int numSubs = 0;
+    for(int c = 0; c < numChanged; c++){
+      int pos = changed[c];
+      if(parent->board[pos] != EMPTY){
+	subs[numSubs++] = net->featureRow(nnueFeature(p, bucket, parent->board[pos], pos));
+      }
+      if(child->board[pos] != EMPTY){
+	adds[numAdds++] = net->featureRow(nnueFeature(p, bucket, child->board[pos], pos));
+      }
+    }
+    nnueApply(parentAcc->values[p], childAcc->values[p], adds, numAdds, subs, numSubs);
+  }
+}
+
+//clamp((bias + dot) >> shift, 0, 127) for every output
+void
+nnueLayer(const uint8_t* in, int numIn, const int8_t* weights, const int32_t* bias, uint8_t* out, int numOut){
+  for(int o = 0; o < numOut; o++){
+    int sum = (bias[o] + nnueDot(in, weights+(o*numIn), numIn)) >> nnueHiddenShift;
+    out[o] = (sum < 0) ? 0 : ((sum > 127) ? 127 : sum);
+  }
+}
+
+//centipawns for the side to move
+int
+nnueEvaluate(nnueNetwork* net, nnueAccumulator* acc, bool whiteToMove){
+  alignas(64) uint8_t input[2*nnueHidden];
+  alignas(64) uint8_t hidden2[nnueL2];
+  alignas(64) uint8_t hidden3[nnueL3];
+  int us = whiteToMove ? 0 : 1;
+  nnueClamp(acc->values[us], input);
+  nnueClamp(acc->values[1-us], input+nnueHidden);
+  nnueLayer(input, 2*nnueHidden, net->l2Weights, net->l2Bias, hidden2, nnueL2);
+  nnueLayer(hidden2, nnueL2, net->l3Weights, net->l3Bias, hidden3, nnueL3);
+  int eval = (*net->outputBias + nnueDot(hidden3, net->outputWeights, nnueL3))/nnueOutputDivisor;
+  return std::max(-nnueMaxEval, std::min(eval, nnueMaxEval));
+}
+
+//a network of random weights in the right format, for checking the kernels and plumbing without a trained one
+bool
+nnueWriteRandomNetwork(const char* path, unsigned long long seed){
+  size_t offsets[9];
+  nnueNetwork::layout(offsets);
+  std::vector<char> file(offsets[8], 0);
+  memcpy(&file[0], "SUCNNUE1", 8);
+  int32_t dims[4] = {nnueFeatures, nnueHidden, nnueL2, nnueL3};
+  memcpy(&file[8], dims, sizeof(dims));
+  int16_t* featureBias = (int16_t*)&file[offsets[0]];
+  int16_t* featureWeights = (int16_t*)&file[offsets[1]];
+  for(int i = 0; i < nnueHidden; i++){
+    featureBias[i] = (int)(zobristKeys::nextRandom(&seed)%64) - 16;
+  }
+  for(size_t i = 0; i < (size_t)nnueFeatures*nnueHidden; i++){
+    featureWeights[i] = (int)(zobristKeys::nextRandom(&seed)%33) - 16;
+  }
+  int8_t* weightSections[3] = {(int8_t*)&file[offsets[3]], (int8_t*)&file[offsets[5]], (int8_t*)&file[offsets[7]]};
+  int weightCounts[3] = {nnueL2*2*nnueHidden, nnueL3*nnueL2, nnueL3};
+  for(int s = 0; s < 3; s++){
+    for(int i = 0; i < weightCounts[s]; i++){
+      weightSections[s][i] = (int)(zobristKeys::nextRandom(&seed)%256) - 128;
+    }
+  }
+  int32_t* biasSections[3] = {(int32_t*)&file[offsets[2]], (int32_t*)&file[offsets[4]], (int32_t*)&file[offsets[6]]};
+  int biasCounts[3] = {nnueL2, nnueL3, 1};
+  for(int s = 0; s < 3; s++){
+    for(int i = 0; i < biasCounts[s]; i++){
+      biasSections[s][i] = (int)(zobristKeys::nextRandom(&seed)%4096) - 2048;
+    }
+  }
+  FILE* f = fopen(path, "wb");
+  if(f == NULL){
+    printf("failed to open \"%s\": %s\n", path, strerror(errno));
+    return false;
+  }
+  bool ok = (fwrite(&file[0], 1, file.size(), f) == file.size());
+  fclose(f);
+  return ok;
+}
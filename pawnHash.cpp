@@ -0,0 +1,151 @@
+//pawn structure eval for the built in search, cached under boardState's pawn-only key
+//pawns hardly move so nearly every probe hits, each search thread has its own table so nothing needs to be atomic
+
+//by how far the pawn has come, index 1 is its starting rank
+const int pawnPassedMg[8] = {0, 5, 10, 15, 25, 40, 60, 0};
+const int pawnPassedEg[8] = {0, 10, 20, 35, 60, 100, 150, 0};
+const int pawnIsolatedMg = -10;
+const int pawnIsolatedEg = -15;
+const int pawnDoubledMg = -10;
+const int pawnDoubledEg = -20;
+const int pawnBackwardMg = -8;
+const int pawnBackwardEg = -10;
+//own pawn in front of the king on its file or a neighbouring one, by how far that pawn has come, 0 is no pawn and 1 unmoved
+const int pawnShelter[8] = {-15, 15, 8, 3, 0, 0, 0, 0};
+
+unsigned long long
+squareBit(int x, int y){
+  return 1ULL << (x + y*8);
+}
+
+class pawnEntry {
+public:
+  unsigned long long key;
+  bool used = false;
+  int mg;//white's point of view
+  int eg;
+  unsigned long long attacks[2];//white, black, squares their pawns attack now
+  unsigned long long attackSpans[2];//squares they could ever attack by advancing, nothing outside the other side's span can be chased off by a pawn
+  int shelter[2][8];//each side's shelter for its king on each file, added in the middlegame only
+
+  void
+  compute(boardState* state){
+    key = state->pawnKey;
+    used = true;
+    mg = 0;
+    eg = 0;
+    //pawnsOn[side][x] has bit y set for every pawn of side on file x
+    int pawnsOn[2][8];
+    memset(pawnsOn, 0, sizeof(pawnsOn));
+    for(int i = 0; i < 64; i++){
+      if(state->board[i] == 'P'){
+	pawnsOn[0][i%8] |= 1 << (i/8);
+      }else if(state->board[i] == 'p'){
+	pawnsOn[1][i%8] |= 1 << (i/8);
+      }
+    }
+    for(int side = 0; side < 2; side++){
+      attacks[side] = 0;
+      attackSpans[side] = 0;
+      int dir = (side == 0) ? -1 : 1;
+      for(int x = 0; x < 8; x++){
+	for(int y = 0; y < 8; y++){
+	  if(!(pawnsOn[side][x] & (1 << y))){
+	    continue;
+	  }
+	  for(int dx = -1; dx <= 1; dx += 2){
+	    if((x+dx < 0)||(x+dx > 7)){
+	      continue;
+	    }
+	    attacks[side] |= squareBit(x+dx, y+dir);
+	    for(int ay = y+dir; (ay >= 0)&&(ay < 8); ay += dir){
+	      attackSpans[side] |= squareBit(x+dx, ay);
+	    }
+	  }
+	}
+      }
+    }
+    for(int side = 0; side < 2; side++){
+      int sign = (side == 0) ? 1 : -1;
+      int dir = (side == 0) ? -1 : 1;
+      int enemy = 1-side;
+      for(int x = 0; x < 8; x++){
+	int neighbours = ((x > 0) ? pawnsOn[side][x-1] : 0) | ((x < 7) ? pawnsOn[side][x+1] : 0);
+	for(int y = 0; y < 8; y++){
+	  if(!(pawnsOn[side][x] & (1 << y))){
+	    continue;
+	  }
+	  int advanced = (side == 0) ? (7-y) : y;
+	  //ranks strictly in front of the pawn, and ranks level with or behind it
+	  int ahead = (side == 0) ? ((1 << y)-1) : (0xFF & ~((2 << y)-1));
+	  int levelOrBehind = 0xFF & ~ahead;
+	  int enemyInFront = pawnsOn[enemy][x] | ((x > 0) ? pawnsOn[enemy][x-1] : 0) | ((x < 7) ? pawnsOn[enemy][x+1] : 0);
+	  if(!(enemyInFront & ahead)){
+	    mg += sign*pawnPassedMg[advanced];
+	    eg += sign*pawnPassedEg[advanced];
+	  }
+	  if(pawnsOn[side][x] & ahead){
+	    mg += sign*pawnDoubledMg;
+	    eg += sign*pawnDoubledEg;
+	  }
+	  if(neighbours == 0){
+	    mg += sign*pawnIsolatedMg;
+	    eg += sign*pawnIsolatedEg;
+	  }else if((!(neighbours & levelOrBehind))&&(attacks[enemy] & squareBit(x, y+dir))){
+	    //nothing beside or behind it to come up in support, and it can't step forward safely
+	    mg += sign*pawnBackwardMg;
+	    eg += sign*pawnBackwardEg;
+	  }
+	}
+      }
+      for(int kingFile = 0; kingFile < 8; kingFile++){
+	shelter[side][kingFile] = 0;
+	for(int x = std::max(kingFile-1, 0); x <= std::min(kingFile+1, 7); x++){
+	  //the pawn closest to our own back rank on that file
+	  int closest = 0;
+	  for(int advanced = 1; advanced < 7; advanced++){
+	    int y = (side == 0) ? (7-advanced) : advanced;
+	    if(pawnsOn[side][x] & (1 << y)){
+	      closest = advanced;
+	      break;
+	    }
+	  }
+	  shelter[side][kingFile] += pawnShelter[closest];
+	}
+      }
+    }
+  }
+};
+
+class pawnHashTable {
+public:
+  static const int numEntries = 8192;//about 1MB, power of two
+  pawnEntry* entries;
+  long long probes = 0;
+  long long hits = 0;
+
+  pawnHashTable(void){
+    entries = new pawnEntry[numEntries];
+  }
+
+  ~pawnHashTable(void){
+    delete[] entries;
+  }
+
+  pawnEntry*
+  probe(boardState* state){
+    probes++;
+    pawnEntry* entry = &entries[state->pawnKey & (numEntries-1)];
+    if(entry->used&&(entry->key == state->pawnKey)){
+      hits++;
+      return entry;
+    }
+    entry->compute(state);
+    return entry;
+  }
+
+  double
+  hitRate(void){
+    return (probes > 0) ? (100.0*hits/probes) : 0;
+  }
+};
@@ -0,0 +1,255 @@
+//hardware performance counters around named regions, only compiled in with -DPERF_COUNTERS
+//regions are inclusive, isInCheck counts the generatePseudoLegalMoves it calls too
+
+enum {
+  perfRegion_perft,
+  perfRegion_generatePseudoLegalMoves,
+  perfRegion_isInCheck,
+  perfRegion_forceMove,
+  perfRegion_engineRead,
+  numPerfRegions
+};
+
+#ifdef PERF_COUNTERS
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include <atomic>
+
+const char* perfRegionNames[numPerfRegions] = {
+  "perft",
+  "generatePseudoLegalMoves",
+  "isInCheck",
+  "forceMove",
+  "engine read loop",
+};
+
+enum {
+  perfCounter_taskClock,
+  perfCounter_cycles,
+  perfCounter_instructions,
+  perfCounter_branchMisses,
+  perfCounter_l1dMisses,
+  perfCounter_llcMisses,
+  numPerfCounters
+};
+
+const char* perfCounterNames[numPerfCounters] = {
+  "task-clock ns",
+  "cycles",
+  "instructions",
+  "branch-misses",
+  "L1D-misses",
+  "LLC-misses",
+};
+
+const unsigned int perfCounterTypes[numPerfCounters] = {
+  PERF_TYPE_SOFTWARE,
+  PERF_TYPE_HARDWARE,
+  PERF_TYPE_HARDWARE,
+  PERF_TYPE_HARDWARE,
+  PERF_TYPE_HW_CACHE,
+  PERF_TYPE_HARDWARE,
+};
+
+const unsigned long long perfCounterConfigs[numPerfCounters] = {
+  PERF_COUNT_SW_TASK_CLOCK,
+  PERF_COUNT_HW_CPU_CYCLES,
+  PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_BRANCH_MISSES,
+  PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+  PERF_COUNT_HW_CACHE_MISSES,
+};
+
+//-1 nobody tried yet, 0 failed, 1 working
+std::atomic<int> perfCounterState[numPerfCounters] = {{-1}, {-1}, {-1}, {-1}, {-1}, {-1}};
+std::atomic<int> perfCounterErrno[numPerfCounters];
+
+std::atomic<long long> perfRegionCalls[numPerfRegions];
+std::atomic<long long> perfRegionTotals[numPerfRegions][numPerfCounters];
+
+class perfCounter {
+public:
+  int fd = -1;
+  perf_event_mmap_page* page = NULL;
+
+  bool
+  openCounter(unsigned int type, unsigned long long config){
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);//this thread, any cpu
+    if(fd < 0){
+      return false;
+    }
+    //the mmap page lets hardware counters be read with rdpmc instead of a syscall
+    void* mapped = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd, 0);
+    if(mapped != MAP_FAILED){
+      page = (perf_event_mmap_page*)mapped;
+    }
+    return true;
+  }
+
+  long long
+  readSyscall(void){
+    long long value = 0;
+    if(read(fd, &value, sizeof(value)) != sizeof(value)){
+      return 0;
+    }
+    return value;
+  }
+
+  long long
+  readCounter(void){
+#if defined(__x86_64__) || defined(__i386__)
+    if((page != NULL)&&(page->cap_user_rdpmc)){
+      while(true){
+	unsigned int seq = page->lock;
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+	unsigned int index = page->index;
+	long long offset = page->offset;
+	if(index == 0){//not on a hardware counter right now
+	  return readSyscall();
+	}
+	unsigned int low;
+	unsigned int high;
+	__asm__ volatile("rdpmc" : "=a"(low), "=d"(high) : "c"(index-1));
+	long long pmc = ((unsigned long long)high << 32) | low;
+	int shift = 64-page->pmc_width;
+	pmc = (pmc << shift) >> shift;
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+	if(page->lock == seq){
+	  return offset+pmc;
+	}
+      }
+    }
+#endif
+    return readSyscall();
+  }
+};
+
+class perfThreadCounters {
+public:
+  bool opened = false;
+  perfCounter counters[numPerfCounters];
+
+  void
+  openAll(void){
+    opened = true;
+    for(int i = 0; i < numPerfCounters; i++){
+      bool success = counters[i].openCounter(perfCounterTypes[i], perfCounterConfigs[i]);
+      int expected = -1;
+      if(success){
+	perfCounterState[i] = 1;
+      }else if(perfCounterState[i].compare_exchange_strong(expected, 0)){
+	perfCounterErrno[i] = errno;
+      }
+    }
+  }
+
+  void
+  readAll(long long values[numPerfCounters]){
+    if(!opened){
+      openAll();
+    }
+    for(int i = 0; i < numPerfCounters; i++){
+      values[i] = (counters[i].fd >= 0) ? counters[i].readCounter() : 0;
+    }
+  }
+};
+
+thread_local perfThreadCounters perfThread;
+
+class perfRegionScope {
+public:
+  int region;
+  long long start[numPerfCounters];
+
+  perfRegionScope(int region_){
+    region = region_;
+    perfThread.readAll(start);
+  }
+
+  ~perfRegionScope(void){
+    long long end[numPerfCounters];
+    perfThread.readAll(end);
+    perfRegionCalls[region].fetch_add(1, std::memory_order_relaxed);
+    for(int i = 0; i < numPerfCounters; i++){
+      perfRegionTotals[region][i].fetch_add(end[i]-start[i], std::memory_order_relaxed);
+    }
+  }
+};
+
+#define PERF_REGION(region) perfRegionScope perfRegionScope_##region(region)
+
+void
+perfCountersReset(void){
+  for(int r = 0; r < numPerfRegions; r++){
+    perfRegionCalls[r] = 0;
+    for(int i = 0; i < numPerfCounters; i++){
+      perfRegionTotals[r][i] = 0;
+    }
+  }
+}
+
+//nodes > 0 adds a per node line for every region, for perft runs
+void
+perfCountersReport(long long nodes){
+  bool anyWorking = false;
+  for(int i = 0; i < numPerfCounters; i++){
+    if(perfCounterState[i] == 1){
+      anyWorking = true;
+    }else if(perfCounterState[i] == 0){
+      printf("counter %s unavailable: %s\n", perfCounterNames[i], strerror(perfCounterErrno[i]));
+    }
+  }
+  if(!anyWorking){
+    printf("no performance counters available, region timings not measured\n");
+    return;
+  }
+  printf("%-26s %-6s %12s", "region", "per", "calls");
+  for(int i = 0; i < numPerfCounters; i++){
+    printf(" %15s", perfCounterNames[i]);
+  }
+  printf(" %6s\n", "IPC");
+  for(int r = 0; r < numPerfRegions; r++){
+    long long calls = perfRegionCalls[r];
+    if(calls == 0){
+      continue;
+    }
+    const char* perNames[3] = {"total", "call", "node"};
+    double divisors[3] = {1, (double)calls, (double)nodes};
+    for(int row = 0; row < 3; row++){
+      if((row == 2)&&(nodes <= 0)){
+	continue;
+      }
+      printf("%-26s %-6s %12lld", (row == 0) ? perfRegionNames[r] : "", perNames[row], calls);
+      for(int i = 0; i < numPerfCounters; i++){
+	if(perfCounterState[i] != 1){
+	  printf(" %15s", "n/a");
+	}else{
+	  printf(" %15.1f", perfRegionTotals[r][i]/divisors[row]);
+	}
+      }
+      if((perfCounterState[perfCounter_cycles] == 1)&&(perfRegionTotals[r][perfCounter_cycles] > 0)){
+	printf(" %6.2f", perfRegionTotals[r][perfCounter_instructions]*1.0/perfRegionTotals[r][perfCounter_cycles]);
+      }else{
+	printf(" %6s", "n/a");
+      }
+      printf("\n");
+    }
+  }
+}
+
+#else
+
+#define PERF_REGION(region)
+
+#endif
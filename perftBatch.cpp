@@ -0,0 +1,208 @@
+//perft over a whole file of positions, one position per task on a threadPool
+//input lines are epd perft suite style: "<fen> ;D1 20 ;D2 400 ;D3 8902"
+
+#include <atomic>
+#include <string>
+
+class perftBatchConfig {
+public:
+  int maxDepth = 5;
+  int threads = threadPool::defaultThreadCount();
+  const char* resultsFile = "perft-results.jsonl";
+  const char* mismatchFile = "perft-mismatches.jsonl";
+  double reportSeconds = 2;
+};
+
+class perftBatchProgress {
+public:
+  std::atomic<long long> positions{0};
+  std::atomic<long long> nodes{0};
+  std::atomic<long long> mismatches{0};
+  std::atomic<long long> badLines{0};
+};
+
+class perftBatchOutput {
+public:
+  FILE* results;
+  FILE* mismatches;
+  std::mutex lock;
+};
+
+void
+writeJsonString(FILE* f, const char* s){
+  fputc('"', f);
+  for(; *s != '\0'; s++){
+    if((*s == '"')||(*s == '\\')){
+      fputc('\\', f);
+    }
+    if((unsigned char)*s >= 0x20){
+      fputc(*s, f);
+    }
+  }
+  fputc('"', f);
+}
+
+//returns false if there is no fen before the first ';'
+bool
+parseEpdPerftLine(const char* line, std::string* fen, std::vector<int>* depths, std::vector<long long>* expectedNodes){
+  const char* fields = strchr(line, ';');
+  int fenLength = (fields != NULL) ? fields-line : strlen(line);
+  while((fenLength > 0)&&isspace(line[fenLength-1])){
+    fenLength--;
+  }
+  if(fenLength == 0){
+    return false;
+  }
+  fen->assign(line, fenLength);
+  while(fields != NULL){
+    int depth;
+    long long nodes;
+    if(sscanf(fields, ";D%d %lld", &depth, &nodes) == 2){
+      depths->push_back(depth);
+      expectedNodes->push_back(nodes);
+    }
+    fields = strchr(fields+1, ';');
+  }
+  return true;
+}
+
+void
+runPerftBatchPosition(std::string line, long long lineNumber, perftBatchConfig* config, perftBatchOutput* output, perftBatchProgress* progress){
+  std::string fen;
+  std::vector<int> depths;
+  std::vector<long long> expectedNodes;
+  boardState state;
+  if((!parseEpdPerftLine(line.c_str(), &fen, &depths, &expectedNodes))||(!state.loadFromFen(fen.c_str()))){
+    progress->badLines++;
+    std::unique_lock<std::mutex> guard(output->lock);
+    fprintf(output->mismatches, "{\"line\": %lld, \"error\": \"bad position\", \"input\": ", lineNumber);
+    writeJsonString(output->mismatches, line.c_str());
+    fprintf(output->mismatches, "}\n");
+    return;
+  }
+  if(depths.empty()){//nothing to check against, just count
+    depths.push_back(config->maxDepth);
+    expectedNodes.push_back(-1);
+  }
+
+  double start = nowNanoseconds();
+  std::vector<long long> nodes(depths.size(), -1);
+  bool ok = true;
+  for(int i = 0; i < (int)depths.size(); i++){
+    if((depths[i] < 1)||(depths[i] > config->maxDepth)){
+      continue;
+    }
+    nodes[i] = nodeTree(depths[i], state);
+    progress->nodes += nodes[i];
+    if((expectedNodes[i] >= 0)&&(nodes[i] != expectedNodes[i])){
+      ok = false;
+    }
+  }
+  double elapsedMs = (nowNanoseconds()-start)*1e-6;
+  progress->positions++;
+  if(!ok){
+    progress->mismatches++;
+  }
+
+  std::unique_lock<std::mutex> guard(output->lock);
+  FILE* files[2] = {output->results, ok ? NULL : output->mismatches};
+  for(int f = 0; f < 2; f++){
+    if(files[f] == NULL){
+      continue;
+    }
+    fprintf(files[f], "{\"line\": %lld, \"fen\": ", lineNumber);
+    writeJsonString(files[f], fen.c_str());
+    fprintf(files[f], ", \"ok\": %s, \"ms\": %.3f, \"results\": [", ok ? "true" : "false", elapsedMs);
+    bool first = true;
+    for(int i = 0; i < (int)depths.size(); i++){
+      if(nodes[i] < 0){
+	continue;
+      }
+      fprintf(files[f], "%s{\"depth\": %d, \"nodes\": %lld", first ? "" : ", ", depths[i], nodes[i]);
+      if(expectedNodes[i] >= 0){
+	fprintf(files[f], ", \"expected\": %lld", expectedNodes[i]);
+      }
+      fprintf(files[f], "}");
+      first = false;
+    }
+    fprintf(files[f], "]}\n");
+  }
+}
+
+void
+printPerftBatchProgress(perftBatchProgress* progress, double startNs){
+  double seconds = (nowNanoseconds()-startNs)*1e-9;
+  long long positions = progress->positions;
+  long long nodes = progress->nodes;
+  printf("%lld positions, %lld nodes, %.0f nodes/s, %.1f positions/s, %lld mismatches, %lld bad lines\n",
+	 positions, nodes, nodes/seconds, positions/seconds, (long long)progress->mismatches, (long long)progress->badLines);
+  fflush(stdout);
+}
+
+//returns mismatches plus unreadable lines, 0 means everything matched
+long long
+runPerftBatch(const char* filename, perftBatchConfig* config){
+  FILE* input = (strcmp(filename, "-") == 0) ? stdin : fopen(filename, "r");
+  if(input == NULL){
+    printf("failed to open \"%s\": %s\n", filename, strerror(errno));
+    exit(1);
+  }
+  perftBatchOutput output;
+  output.results = fopen(config->resultsFile, "w");
+  output.mismatches = fopen(config->mismatchFile, "w");
+  if((output.results == NULL)||(output.mismatches == NULL)){
+    printf("failed to open output files: %s\n", strerror(errno));
+    exit(1);
+  }
+  printf("perft batch \"%s\" up to depth %d on %d threads, results to \"%s\", mismatches to \"%s\"\n",
+	 filename, config->maxDepth, config->threads, config->resultsFile, config->mismatchFile);
+
+  perftBatchProgress progress;
+  double startNs = nowNanoseconds();
+  std::atomic<bool> finished{false};
+  std::thread reporter([&]{
+    double lastReport = nowNanoseconds();
+    while(!finished){
+      usleep(100000);
+      if((nowNanoseconds()-lastReport)*1e-9 >= config->reportSeconds){
+	printPerftBatchProgress(&progress, startNs);
+	lastReport = nowNanoseconds();
+      }
+    }
+  });
+
+  {
+    threadPool pool(config->threads, config->threads*4);
+    char* line = NULL;
+    size_t capacity = 0;
+    long long lineNumber = 0;
+    while(getline(&line, &capacity, input) != -1){
+      lineNumber++;
+      int length = strlen(line);
+      while((length > 0)&&isspace(line[length-1])){
+	line[--length] = '\0';
+      }
+      if((length == 0)||(line[0] == '#')){
+	continue;
+      }
+      std::string task(line);
+      long long taskLine = lineNumber;
+      pool.submit([task, taskLine, config, &output, &progress]{
+	runPerftBatchPosition(task, taskLine, config, &output, &progress);
+      });
+    }
+    free(line);
+    pool.waitIdle();
+  }
+  finished = true;
+  reporter.join();
+
+  if(input != stdin){
+    fclose(input);
+  }
+  fclose(output.results);
+  fclose(output.mismatches);
+  printf("done: ");
+  printPerftBatchProgress(&progress, startNs);
+  return progress.mismatches + progress.badLines;
+}
@@ -0,0 +1,600 @@
+//in-check, legal move count and game status for a whole batch of positions at once, for labelling/validating datasets
+//positions are stored structure-of-arrays as bitboards, bit n of every bitboard is board[n] (a8 = bit 0, h1 = bit 63)
+//moves are counted set-wise (every direction shifts a whole set of pieces at once) so the same code runs 4 positions per avx2 register
+
+#include <vector>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define POSITION_BATCH_AVX2
+#endif
+
+enum {
+  gameStatus_ongoing,
+  gameStatus_checkmate,
+  gameStatus_stalemate,
+  gameStatus_fiftyMoves,
+  numGameStatuses
+};
+
+const char* gameStatusNames[numGameStatuses] = {
+  "ongoing",
+  "checkmate",
+  "stalemate",
+  "fifty moves",
+};
+
+enum {
+  castleBit_whiteKingSide = 1,
+  castleBit_whiteQueenSide = 2,
+  castleBit_blackKingSide = 4,
+  castleBit_blackQueenSide = 8,
+};
+
+class positionBatch {
+public:
+  //input, one entry per position in every array
+  std::vector<unsigned long long> occupied;
+  std::vector<unsigned long long> whitePieces;
+  std::vector<unsigned long long> pawns;
+  std::vector<unsigned long long> knights;
+  std::vector<unsigned long long> bishops;
+  std::vector<unsigned long long> rooks;
+  std::vector<unsigned long long> queens;
+  std::vector<unsigned long long> kings;
+  std::vector<UInt8> whiteToMove;
+  std::vector<UInt8> castling;//castleBit_*
+  std::vector<signed char> enPassantPos;
+  std::vector<int> halfMoves;
+
+  //output, filled in by evaluatePositionBatch
+  std::vector<UInt8> inCheck;
+  std::vector<unsigned short> legalMoveCount;
+  std::vector<UInt8> status;//gameStatus_*
+
+  int
+  size(void){
+    return occupied.size();
+  }
+
+  void
+  clear(void){
+    occupied.clear();
+    whitePieces.clear();
+    pawns.clear();
+    knights.clear();
+    bishops.clear();
+    rooks.clear();
+    queens.clear();
+    kings.clear();
+    whiteToMove.clear();
+    castling.clear();
+    enPassantPos.clear();
+    halfMoves.clear();
+    inCheck.clear();
+    legalMoveCount.clear();
+    status.clear();
+  }
+
+  void
+  add(boardState* state){
+    unsigned long long bits[6] = {0, 0, 0, 0, 0, 0};
+    unsigned long long all = 0;
+    unsigned long long white = 0;
+    for(int i = 0; i < 64; i++){
+      const char* piece = (state->board[i] == EMPTY) ? NULL : strchr("pnbrqk", tolower(state->board[i]));
+      if(piece == NULL){
+	continue;
+      }
+      bits[piece-"pnbrqk"] |= 1ULL << i;
+      all |= 1ULL << i;
+      if(state->isWhite(i)){
+	white |= 1ULL << i;
+      }
+    }
+    occupied.push_back(all);
+    whitePieces.push_back(white);
+    pawns.push_back(bits[0]);
+    knights.push_back(bits[1]);
+    bishops.push_back(bits[2]);
+    rooks.push_back(bits[3]);
+    queens.push_back(bits[4]);
+    kings.push_back(bits[5]);
+    whiteToMove.push_back(state->isWhitesTurn);
+    castling.push_back((state->whiteCanCastleKingSide ? castleBit_whiteKingSide : 0) | (state->whiteCanCastleQueenSide ? castleBit_whiteQueenSide : 0) |
+		       (state->blackCanCastleKingSide ? castleBit_blackKingSide : 0) | (state->blackCanCastleQueenSide ? castleBit_blackQueenSide : 0));
+    enPassantPos.push_back(state->enPassantPos);
+    halfMoves.push_back(state->halfMoves);
+    inCheck.push_back(0);
+    legalMoveCount.push_back(0);
+    status.push_back(gameStatus_ongoing);
+  }
+};
+
+const unsigned long long notFileA = 0xfefefefefefefefeULL;
+const unsigned long long notFileH = 0x7f7f7f7f7f7f7f7fULL;
+const unsigned long long notFileAB = 0xfcfcfcfcfcfcfcfcULL;
+const unsigned long long notFileGH = 0x3f3f3f3f3f3f3f3fULL;
+const unsigned long long allSquares = ~0ULL;
+
+//same order as directions[], a piece shifted by directions[dir] must not land on these files or it wrapped around the board
+const unsigned long long directionWrapMask[8] = {notFileH, notFileA, allSquares, allSquares, notFileH, notFileA, notFileH, notFileA};
+//pins are along a line, a piece pinned on one direction can still move in the opposite one
+const int directionAxis[8] = {0, 0, 1, 1, 2, 3, 3, 2};
+const int knightShifts[8] = {-17, -15, -10, -6, 6, 10, 15, 17};
+const unsigned long long knightWrapMask[8] = {notFileH, notFileA, notFileGH, notFileAB, notFileGH, notFileAB, notFileH, notFileA};
+
+//where a single pawn push lands when it could have been a double push, and where pawns promote
+const unsigned long long whitePushRow = 0xffULL << 40;
+const unsigned long long blackPushRow = 0xffULL << 16;
+const unsigned long long whitePromotionRow = 0xffULL;
+const unsigned long long blackPromotionRow = 0xffULL << 56;
+
+//direction indices into directions[]
+const int whitePush = 2;
+const int blackPush = 3;
+const int whiteCaptures[2] = {4, 5};
+const int blackCaptures[2] = {7, 6};//same axis as whiteCaptures[] at the same index
+
+static inline unsigned long long
+shiftBits(unsigned long long b, int shift){
+  return (shift > 0) ? (b << shift) : (b >> -shift);
+}
+
+static inline unsigned long long
+stepBits(unsigned long long b, int dir){
+  return shiftBits(b, directions[dir]) & directionWrapMask[dir];
+}
+
+//every square the sliders reach going in dir, up to and including the first piece in the way
+static inline unsigned long long
+slideBits(unsigned long long sliders, unsigned long long empty, int dir){
+  int shift = directions[dir];
+  empty &= directionWrapMask[dir];
+  sliders |= empty & shiftBits(sliders, shift);
+  empty &= shiftBits(empty, shift);
+  sliders |= empty & shiftBits(sliders, 2*shift);
+  empty &= shiftBits(empty, 2*shift);
+  sliders |= empty & shiftBits(sliders, 4*shift);
+  return shiftBits(sliders, shift) & directionWrapMask[dir];
+}
+
+static inline unsigned long long
+pawnAttackBits(unsigned long long pawnBits, bool white){
+  const int* dirs = white ? whiteCaptures : blackCaptures;
+  return stepBits(pawnBits, dirs[0]) | stepBits(pawnBits, dirs[1]);
+}
+
+static inline unsigned long long
+knightBits(unsigned long long knightSquares){
+  unsigned long long attacks = 0;
+  for(int i = 0; i < 8; i++){
+    attacks |= shiftBits(knightSquares, knightShifts[i]) & knightWrapMask[i];
+  }
+  return attacks;
+}
+
+static inline unsigned long long
+kingBits(unsigned long long kingSquares){
+  unsigned long long attacks = 0;
+  for(int dir = 0; dir < 8; dir++){
+    attacks |= stepBits(kingSquares, dir);
+  }
+  return attacks;
+}
+
+static inline unsigned long long
+attackedSquares(positionBatch* batch, int i, unsigned long long attackers, bool attackersWhite, unsigned long long occupied){
+  unsigned long long empty = ~occupied;
+  unsigned long long attacked = pawnAttackBits(attackers & batch->pawns[i], attackersWhite);
+  attacked |= knightBits(attackers & batch->knights[i]);
+  attacked |= kingBits(attackers & batch->kings[i]);
+  unsigned long long straight = attackers & (batch->rooks[i] | batch->queens[i]);
+  unsigned long long diagonal = attackers & (batch->bishops[i] | batch->queens[i]);
+  for(int dir = 0; dir < 8; dir++){
+    attacked |= slideBits((dir < 4) ? straight : diagonal, empty, dir);
+  }
+  return attacked;
+}
+
+//en passant is rare and its legality depends on two squares emptying at once, so both kernels leave it to this
+static int
+enPassantMoveCount(positionBatch* batch, int i){
+  int ep = batch->enPassantPos[i];
+  if((ep < 0)||(batch->occupied[i] & (1ULL << ep))){
+    return 0;
+  }
+  bool white = batch->whiteToMove[i];
+  unsigned long long occupied = batch->occupied[i];
+  unsigned long long own = white ? batch->whitePieces[i] : (occupied & ~batch->whitePieces[i]);
+  unsigned long long king = own & batch->kings[i];
+  unsigned long long epBit = 1ULL << ep;
+  unsigned long long capturedBit = white ? (epBit << 8) : (epBit >> 8);
+  unsigned long long capturers = pawnAttackBits(epBit, !white) & own & batch->pawns[i];
+  int count = 0;
+  while(capturers != 0){
+    unsigned long long from = capturers & -capturers;
+    capturers ^= from;
+    unsigned long long after = (occupied & ~from & ~capturedBit) | epBit;
+    unsigned long long enemy = occupied & ~own & ~capturedBit;
+    if(!(attackedSquares(batch, i, enemy, !white, after) & king)){
+      count++;
+    }
+  }
+  return count;
+}
+
+static inline void
+finishBatchPosition(positionBatch* batch, int i, int count, bool inCheck){
+  count += enPassantMoveCount(batch, i);
+  batch->inCheck[i] = inCheck;
+  batch->legalMoveCount[i] = count;
+  if(count == 0){
+    batch->status[i] = inCheck ? gameStatus_checkmate : gameStatus_stalemate;
+  }else if(batch->halfMoves[i] > fifty_move_rule_max){
+    batch->status[i] = gameStatus_fiftyMoves;
+  }else{
+    batch->status[i] = gameStatus_ongoing;
+  }
+}
+
+void
+positionBatchScalar(positionBatch* batch, int begin, int end){
+  for(int i = begin; i < end; i++){
+    bool white = batch->whiteToMove[i];
+    unsigned long long occupied = batch->occupied[i];
+    unsigned long long empty = ~occupied;
+    unsigned long long own = white ? batch->whitePieces[i] : (occupied & ~batch->whitePieces[i]);
+    unsigned long long enemy = occupied & ~own;
+    unsigned long long king = own & batch->kings[i];
+    unsigned long long straight = batch->rooks[i] | batch->queens[i];
+    unsigned long long diagonal = batch->bishops[i] | batch->queens[i];
+
+    //look outwards from our king, an enemy slider is either checking or pinning whatever single piece of ours is in between
+    unsigned long long checkers = 0;
+    unsigned long long blockSquares = 0;
+    unsigned long long pinned[4] = {0, 0, 0, 0};
+    for(int dir = 0; dir < 8; dir++){
+      unsigned long long sliders = enemy & ((dir < 4) ? straight : diagonal);
+      unsigned long long ray = slideBits(king, empty, dir);
+      if(ray & sliders){
+	checkers |= ray & sliders;
+	blockSquares |= ray;
+      }
+      unsigned long long blocker = ray & own;
+      if(slideBits(king, empty | blocker, dir) & sliders){
+	pinned[directionAxis[dir]] |= blocker;
+      }
+    }
+    checkers |= knightBits(king) & enemy & batch->knights[i];
+    checkers |= pawnAttackBits(king, white) & enemy & batch->pawns[i];
+    int numCheckers = __builtin_popcountll(checkers);
+    unsigned long long checkMask = (numCheckers == 0) ? allSquares : ((numCheckers == 1) ? (checkers | blockSquares) : 0);
+    unsigned long long allPinned = pinned[0] | pinned[1] | pinned[2] | pinned[3];
+    unsigned long long targets = ~own & checkMask;
+
+    //each direction moves every piece at once, two pieces can't reach the same square from the same direction so popcount is exact
+    int count = 0;
+    unsigned long long ownKnights = own & batch->knights[i] & ~allPinned;
+    for(int j = 0; j < 8; j++){
+      count += __builtin_popcountll(shiftBits(ownKnights, knightShifts[j]) & knightWrapMask[j] & targets);
+    }
+    for(int dir = 0; dir < 8; dir++){
+      unsigned long long movers = own & ((dir < 4) ? straight : diagonal) & (~allPinned | pinned[directionAxis[dir]]);
+      count += __builtin_popcountll(slideBits(movers, empty, dir) & targets);
+    }
+
+    unsigned long long ownPawns = own & batch->pawns[i];
+    unsigned long long promotionRow = white ? whitePromotionRow : blackPromotionRow;
+    int pushDir = white ? whitePush : blackPush;
+    unsigned long long pushed = stepBits(ownPawns & (~allPinned | pinned[directionAxis[pushDir]]), pushDir) & empty;
+    unsigned long long doublePushed = stepBits(pushed & (white ? whitePushRow : blackPushRow), pushDir) & empty & checkMask;
+    pushed &= checkMask;
+    count += __builtin_popcountll(pushed & ~promotionRow) + 4*__builtin_popcountll(pushed & promotionRow) + __builtin_popcountll(doublePushed);
+    for(int j = 0; j < 2; j++){
+      int dir = white ? whiteCaptures[j] : blackCaptures[j];
+      unsigned long long captures = stepBits(ownPawns & (~allPinned | pinned[directionAxis[dir]]), dir) & enemy & checkMask;
+      count += __builtin_popcountll(captures & ~promotionRow) + 4*__builtin_popcountll(captures & promotionRow);
+    }
+
+    //the king itself can't hide behind its own square from a slider, so take it off the board first
+    unsigned long long attacked = attackedSquares(batch, i, enemy, !white, occupied & ~king);
+    count += __builtin_popcountll(kingBits(king) & ~own & ~attacked);
+    if((numCheckers == 0)&&(king != 0)){
+      int rights = batch->castling[i] >> (white ? 0 : 2);
+      unsigned long long kingSide = (king << 1) | (king << 2);
+      unsigned long long queenSide = (king >> 1) | (king >> 2);
+      if((rights & castleBit_whiteKingSide)&&!(kingSide & (occupied | attacked))){
+	count++;
+      }
+      if((rights & castleBit_whiteQueenSide)&&!(queenSide & (occupied | attacked))&&!((king >> 3) & occupied)){
+	count++;
+      }
+    }
+    finishBatchPosition(batch, i, count, numCheckers > 0);
+  }
+}
+
+#ifdef POSITION_BATCH_AVX2
+
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+
+AVX2_FUNCTION static inline __m256i
+shiftBits4(__m256i b, int shift){
+  return (shift > 0) ? _mm256_slli_epi64(b, shift) : _mm256_srli_epi64(b, -shift);
+}
+
+AVX2_FUNCTION static inline __m256i
+stepBits4(__m256i b, int dir){
+  return _mm256_and_si256(shiftBits4(b, directions[dir]), _mm256_set1_epi64x(directionWrapMask[dir]));
+}
+
+AVX2_FUNCTION static inline __m256i
+slideBits4(__m256i sliders, __m256i empty, int dir){
+  int shift = directions[dir];
+  __m256i wrap = _mm256_set1_epi64x(directionWrapMask[dir]);
+  empty = _mm256_and_si256(empty, wrap);
+  sliders = _mm256_or_si256(sliders, _mm256_and_si256(empty, shiftBits4(sliders, shift)));
+  empty = _mm256_and_si256(empty, shiftBits4(empty, shift));
+  sliders = _mm256_or_si256(sliders, _mm256_and_si256(empty, shiftBits4(sliders, 2*shift)));
+  empty = _mm256_and_si256(empty, shiftBits4(empty, 2*shift));
+  sliders = _mm256_or_si256(sliders, _mm256_and_si256(empty, shiftBits4(sliders, 4*shift)));
+  return _mm256_and_si256(shiftBits4(sliders, shift), wrap);
+}
+
+//no vpopcntq without avx512, count nibbles with a shuffle lookup and add the bytes of each lane with sad
+AVX2_FUNCTION static inline __m256i
+popcount4(__m256i v){
+  const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+					  0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i lowNibbles = _mm256_set1_epi8(0x0f);
+  __m256i low = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, lowNibbles));
+  __m256i high = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), lowNibbles));
+  return _mm256_sad_epu8(_mm256_add_epi8(low, high), _mm256_setzero_si256());
+}
+
+AVX2_FUNCTION static inline __m256i
+isZero4(__m256i v){
+  return _mm256_cmpeq_epi64(v, _mm256_setzero_si256());
+}
+
+AVX2_FUNCTION static inline __m256i
+load4(std::vector<unsigned long long>& bits, int i){
+  return _mm256_loadu_si256((const __m256i*)&bits[i]);
+}
+
+//4 bytes widened to one 64 bit lane each
+AVX2_FUNCTION static inline __m256i
+loadBytes4(const UInt8* bytes){
+  int packed;
+  memcpy(&packed, bytes, sizeof(packed));
+  return _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(packed));
+}
+
+//lanes where whiteLanes is set use the white version
+AVX2_FUNCTION static inline __m256i
+pickByColor4(__m256i whiteLanes, __m256i forWhite, __m256i forBlack){
+  return _mm256_blendv_epi8(forBlack, forWhite, whiteLanes);
+}
+
+AVX2_FUNCTION static inline __m256i
+pawnAttackBits4(__m256i pawnBits, __m256i whiteLanes){
+  __m256i whiteAttacks = _mm256_or_si256(stepBits4(pawnBits, whiteCaptures[0]), stepBits4(pawnBits, whiteCaptures[1]));
+  __m256i blackAttacks = _mm256_or_si256(stepBits4(pawnBits, blackCaptures[0]), stepBits4(pawnBits, blackCaptures[1]));
+  return pickByColor4(whiteLanes, whiteAttacks, blackAttacks);
+}
+
+AVX2_FUNCTION static inline __m256i
+knightBits4(__m256i knightSquares){
+  __m256i attacks = _mm256_setzero_si256();
+  for(int i = 0; i < 8; i++){
+    attacks = _mm256_or_si256(attacks, _mm256_and_si256(shiftBits4(knightSquares, knightShifts[i]), _mm256_set1_epi64x(knightWrapMask[i])));
+  }
+  return attacks;
+}
+
+AVX2_FUNCTION static inline __m256i
+kingBits4(__m256i kingSquares){
+  __m256i attacks = _mm256_setzero_si256();
+  for(int dir = 0; dir < 8; dir++){
+    attacks = _mm256_or_si256(attacks, stepBits4(kingSquares, dir));
+  }
+  return attacks;
+}
+
+//same as positionBatchScalar, 4 positions per register, anything that was a branch there is a lane mask here
+AVX2_FUNCTION void
+positionBatchAvx2(positionBatch* batch, int begin, int end){
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi64x(1);
+  int i = begin;
+  for(; i+4 <= end; i += 4){
+    __m256i whiteLanes = _mm256_cmpgt_epi64(loadBytes4(&batch->whiteToMove[i]), zero);
+    __m256i occupied = load4(batch->occupied, i);
+    __m256i empty = _mm256_xor_si256(occupied, _mm256_set1_epi64x(-1));
+    __m256i whitePieces = load4(batch->whitePieces, i);
+    __m256i own = pickByColor4(whiteLanes, whitePieces, _mm256_andnot_si256(whitePieces, occupied));
+    __m256i enemy = _mm256_andnot_si256(own, occupied);
+    __m256i pawns = load4(batch->pawns, i);
+    __m256i knights = load4(batch->knights, i);
+    __m256i queens = load4(batch->queens, i);
+    __m256i kings = load4(batch->kings, i);
+    __m256i straight = _mm256_or_si256(load4(batch->rooks, i), queens);
+    __m256i diagonal = _mm256_or_si256(load4(batch->bishops, i), queens);
+    __m256i king = _mm256_and_si256(own, kings);
+
+    __m256i checkers = zero;
+    __m256i blockSquares = zero;
+    __m256i pinned[4] = {zero, zero, zero, zero};
+    for(int dir = 0; dir < 8; dir++){
+      __m256i sliders = _mm256_and_si256(enemy, (dir < 4) ? straight : diagonal);
+      __m256i ray = slideBits4(king, empty, dir);
+      __m256i hit = _mm256_and_si256(ray, sliders);
+      checkers = _mm256_or_si256(checkers, hit);
+      blockSquares = _mm256_or_si256(blockSquares, _mm256_andnot_si256(isZero4(hit), ray));
+      __m256i blocker = _mm256_and_si256(ray, own);
+      __m256i pinner = _mm256_and_si256(slideBits4(king, _mm256_or_si256(empty, blocker), dir), sliders);
+      pinned[directionAxis[dir]] = _mm256_or_si256(pinned[directionAxis[dir]], _mm256_andnot_si256(isZero4(pinner), blocker));
+    }
+    checkers = _mm256_or_si256(checkers, _mm256_and_si256(knightBits4(king), _mm256_and_si256(enemy, knights)));
+    checkers = _mm256_or_si256(checkers, _mm256_and_si256(pawnAttackBits4(king, whiteLanes), _mm256_and_si256(enemy, pawns)));
+    __m256i numCheckers = popcount4(checkers);
+    __m256i notInCheck = isZero4(numCheckers);
+    __m256i checkMask = _mm256_or_si256(notInCheck, _mm256_and_si256(_mm256_cmpeq_epi64(numCheckers, one), _mm256_or_si256(checkers, blockSquares)));
+    __m256i allPinned = _mm256_or_si256(_mm256_or_si256(pinned[0], pinned[1]), _mm256_or_si256(pinned[2], pinned[3]));
+    __m256i targets = _mm256_andnot_si256(own, checkMask);
+
+    __m256i count = zero;
+    __m256i ownKnights = _mm256_andnot_si256(allPinned, _mm256_and_si256(own, knights));
+    for(int j = 0; j < 8; j++){
+      __m256i jumped = _mm256_and_si256(shiftBits4(ownKnights, knightShifts[j]), _mm256_set1_epi64x(knightWrapMask[j]));
+      count = _mm256_add_epi64(count, popcount4(_mm256_and_si256(jumped, targets)));
+    }
+    for(int dir = 0; dir < 8; dir++){
+      __m256i canMove = _mm256_or_si256(_mm256_xor_si256(allPinned, _mm256_set1_epi64x(-1)), pinned[directionAxis[dir]]);
+      __m256i movers = _mm256_and_si256(_mm256_and_si256(own, (dir < 4) ? straight : diagonal), canMove);
+      count = _mm256_add_epi64(count, popcount4(_mm256_and_si256(slideBits4(movers, empty, dir), targets)));
+    }
+
+    //both colours' pawn moves get worked out, each lane keeps the one for its side to move
+    __m256i ownPawns = _mm256_and_si256(own, pawns);
+    __m256i promotionRow = pickByColor4(whiteLanes, _mm256_set1_epi64x(whitePromotionRow), _mm256_set1_epi64x(blackPromotionRow));
+    __m256i pushers = _mm256_and_si256(ownPawns, _mm256_or_si256(_mm256_xor_si256(allPinned, _mm256_set1_epi64x(-1)), pinned[directionAxis[whitePush]]));
+    __m256i pushed = _mm256_and_si256(pickByColor4(whiteLanes, stepBits4(pushers, whitePush), stepBits4(pushers, blackPush)), empty);
+    __m256i pushRow = pickByColor4(whiteLanes, _mm256_set1_epi64x(whitePushRow), _mm256_set1_epi64x(blackPushRow));
+    __m256i canDoublePush = _mm256_and_si256(pushed, pushRow);
+    __m256i doublePushed = pickByColor4(whiteLanes, stepBits4(canDoublePush, whitePush), stepBits4(canDoublePush, blackPush));
+    doublePushed = _mm256_and_si256(_mm256_and_si256(doublePushed, empty), checkMask);
+    pushed = _mm256_and_si256(pushed, checkMask);
+    count = _mm256_add_epi64(count, popcount4(_mm256_andnot_si256(promotionRow, pushed)));
+    count = _mm256_add_epi64(count, _mm256_slli_epi64(popcount4(_mm256_and_si256(promotionRow, pushed)), 2));
+    count = _mm256_add_epi64(count, popcount4(doublePushed));
+    for(int j = 0; j < 2; j++){
+      __m256i capturers = _mm256_and_si256(ownPawns, _mm256_or_si256(_mm256_xor_si256(allPinned, _mm256_set1_epi64x(-1)), pinned[directionAxis[whiteCaptures[j]]]));
+      __m256i captures = pickByColor4(whiteLanes, stepBits4(capturers, whiteCaptures[j]), stepBits4(capturers, blackCaptures[j]));
+      captures = _mm256_and_si256(_mm256_and_si256(captures, enemy), checkMask);
+      count = _mm256_add_epi64(count, popcount4(_mm256_andnot_si256(promotionRow, captures)));
+      count = _mm256_add_epi64(count, _mm256_slli_epi64(popcount4(_mm256_and_si256(promotionRow, captures)), 2));
+    }
+
+    __m256i withoutKing = _mm256_or_si256(empty, king);
+    __m256i enemyWhiteLanes = _mm256_xor_si256(whiteLanes, _mm256_set1_epi64x(-1));
+    __m256i attacked = pawnAttackBits4(_mm256_and_si256(enemy, pawns), enemyWhiteLanes);
+    attacked = _mm256_or_si256(attacked, knightBits4(_mm256_and_si256(enemy, knights)));
+    attacked = _mm256_or_si256(attacked, kingBits4(_mm256_and_si256(enemy, kings)));
+    __m256i enemyStraight = _mm256_and_si256(enemy, straight);
+    __m256i enemyDiagonal = _mm256_and_si256(enemy, diagonal);
+    for(int dir = 0; dir < 8; dir++){
+      attacked = _mm256_or_si256(attacked, slideBits4((dir < 4) ? enemyStraight : enemyDiagonal, withoutKing, dir));
+    }
+    __m256i kingMoves = _mm256_andnot_si256(_mm256_or_si256(own, attacked), kingBits4(king));
+    count = _mm256_add_epi64(count, popcount4(kingMoves));
+
+    __m256i castling = loadBytes4(&batch->castling[i]);
+    __m256i rights = pickByColor4(whiteLanes, castling, _mm256_srli_epi64(castling, 2));
+    __m256i canCastle = _mm256_andnot_si256(isZero4(king), notInCheck);
+    __m256i blocked = _mm256_or_si256(occupied, attacked);
+    __m256i kingSide = _mm256_or_si256(_mm256_slli_epi64(king, 1), _mm256_slli_epi64(king, 2));
+    __m256i queenSide = _mm256_or_si256(_mm256_srli_epi64(king, 1), _mm256_srli_epi64(king, 2));
+    __m256i kingSideOk = _mm256_and_si256(canCastle, isZero4(_mm256_and_si256(kingSide, blocked)));
+    kingSideOk = _mm256_andnot_si256(isZero4(_mm256_and_si256(rights, _mm256_set1_epi64x(castleBit_whiteKingSide))), kingSideOk);
+    __m256i queenSideOk = _mm256_and_si256(canCastle, isZero4(_mm256_and_si256(queenSide, blocked)));
+    queenSideOk = _mm256_and_si256(queenSideOk, isZero4(_mm256_and_si256(_mm256_srli_epi64(king, 3), occupied)));
+    queenSideOk = _mm256_andnot_si256(isZero4(_mm256_and_si256(rights, _mm256_set1_epi64x(castleBit_whiteQueenSide))), queenSideOk);
+    count = _mm256_sub_epi64(_mm256_sub_epi64(count, kingSideOk), queenSideOk);//ok lanes are all ones, -1
+
+    long long counts[4];
+    long long checked[4];
+    _mm256_storeu_si256((__m256i*)counts, count);
+    _mm256_storeu_si256((__m256i*)checked, notInCheck);
+    for(int lane = 0; lane < 4; lane++){
+      finishBatchPosition(batch, i+lane, counts[lane], checked[lane] == 0);
+    }
+  }
+  positionBatchScalar(batch, i, end);
+}
+
+bool
+positionBatchHasAvx2(void){
+  return __builtin_cpu_supports("avx2");
+}
+
+#else
+
+void
+positionBatchAvx2(positionBatch* batch, int begin, int end){
+  positionBatchScalar(batch, begin, end);
+}
+
+bool
+positionBatchHasAvx2(void){
+  return false;
+}
+
+#endif
+
+//fills inCheck, legalMoveCount and status for every position, same answers as generateLegalMoves/isInCheck/handleWinConditions
+void
+evaluatePositionBatch(positionBatch* batch){
+  if(positionBatchHasAvx2()){
+    positionBatchAvx2(batch, 0, batch->size());
+  }else{
+    positionBatchScalar(batch, 0, batch->size());
+  }
+}
+
+//"<fen> ;check 0 ;moves 20 ;status ongoing ;eval 0" for every fen (anything after a ';' is ignored) on stdout, returns the number of unreadable lines
+long long
+labelPositionFile(const char* filename){
+  FILE* input = (strcmp(filename, "-") == 0) ? stdin : fopen(filename, "r");
+  if(input == NULL){
+    printf("failed to open \"%s\": %s\n", filename, strerror(errno));
+    exit(1);
+  }
+  const int chunkSize = 4096;
+  positionBatch batch;
+  std::vector<std::string> fens;
+  std::vector<int> evals;
+  long long badLines = 0;
+  char* line = NULL;
+  size_t capacity = 0;
+  bool more = true;
+  while(more){
+    more = (getline(&line, &capacity, input) != -1);
+    if(more){
+      char* end = strchr(line, ';');
+      int length = (end != NULL) ? end-line : strlen(line);
+      while((length > 0)&&isspace(line[length-1])){
+	length--;
+      }
+      line[length] = '\0';
+      boardState state;
+      if((length == 0)||(line[0] == '#')){
+	continue;
+      }
+      if(!state.loadFromFen(line)){
+	fprintf(stderr, "bad position \"%s\"\n", line);
+	badLines++;
+	continue;
+      }
+      batch.add(&state);
+      fens.push_back(line);
+      evals.push_back(state.taperedEval());
+    }
+    if((batch.size() == chunkSize)||((!more)&&(batch.size() > 0))){
+      evaluatePositionBatch(&batch);
+      for(int i = 0; i < batch.size(); i++){
+	printf("%s ;check %d ;moves %d ;status %s ;eval %d\n", fens[i].c_str(), batch.inCheck[i], batch.legalMoveCount[i], gameStatusNames[batch.status[i]], evals[i]);
+      }
+      batch.clear();
+      fens.clear();
+      evals.clear();
+    }
+  }
+  free(line);
+  if(input != stdin){
+    fclose(input);
+  }
+  return badLines;
+}
@@ -0,0 +1,72 @@
+//how long the game takes to get going, time-to-first-frame and time-to-first-move plus what happened on the way
+//included first so its static init runs before Globals and everything else in the unity build
+
+#include <time.h>
+
+#include <atomic>
+
+enum {
+  startupMilestone_mainEntered,
+  startupMilestone_enginesSpawned,
+  startupMilestone_textureDecoded,
+  startupMilestone_windowCreated,
+  startupMilestone_glReady,
+  startupMilestone_firstFrame,
+  startupMilestone_engineReady,
+  startupMilestone_firstMove,
+  numStartupMilestones
+};
+
+const char* startupMilestoneNames[numStartupMilestones] = {
+  "main entered",
+  "engines spawned",
+  "pieces.png decoded",
+  "window + glew",
+  "shaders + texture uploaded",
+  "first frame",
+  "first engine handshake",
+  "first move",
+};
+
+long long
+startupNowNs(void){
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec*1000000000LL) + ts.tv_nsec;
+}
+
+long long startupBeginNs = startupNowNs();
+std::atomic<long long> startupMilestoneNs[numStartupMilestones];
+std::atomic<bool> startupReported{false};
+
+void
+startupReport(void){
+  printf("startup (ms since process start):\n");
+  for(int i = 0; i < numStartupMilestones; i++){
+    long long ns = startupMilestoneNs[i];
+    if(ns != 0){
+      printf("  %-28s %9.1f\n", startupMilestoneNames[i], ns*1e-6);
+    }
+  }
+}
+
+//time spent waiting on the user (the side prompt) isn't startup, later milestones are measured as if it never happened
+//only call before anything else is running
+void
+startupExclude(long long ns){
+  startupBeginNs += ns;
+}
+
+//only the first time each milestone happens counts, the report prints once there's been a frame and a move
+void
+startupMark(int milestone){
+  long long expected = 0;
+  if(!startupMilestoneNs[milestone].compare_exchange_strong(expected, startupNowNs()-startupBeginNs)){
+    return;
+  }
+  if((startupMilestoneNs[startupMilestone_firstFrame] != 0)&&(startupMilestoneNs[startupMilestone_firstMove] != 0)){
+    if(!startupReported.exchange(true)){
+      startupReport();
+    }
+  }
+}
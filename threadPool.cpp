@@ -0,0 +1,87 @@
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+
+//fixed set of workers pulling tasks off one queue, whoever is free takes the next task
+//submit blocks while the queue is full so a producer reading a huge file can't run ahead of the workers
+class threadPool {
+public:
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()>> tasks;
+  std::mutex lock;
+  std::condition_variable taskAvailable;
+  std::condition_variable spaceAvailable;
+  std::condition_variable allDone;
+  int maxQueued;
+  int running = 0;
+  bool stopping = false;
+
+  threadPool(int numThreads, int maxQueued_){
+    maxQueued = maxQueued_;
+    if(numThreads < 1){
+      numThreads = 1;
+    }
+    for(int i = 0; i < numThreads; i++){
+      workers.push_back(std::thread(&threadPool::workerLoop, this));
+    }
+  }
+
+  ~threadPool(void){
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      stopping = true;
+    }
+    taskAvailable.notify_all();
+    for(int i = 0; i < (int)workers.size(); i++){
+      workers[i].join();
+    }
+  }
+
+  static int
+  defaultThreadCount(void){
+    int count = std::thread::hardware_concurrency();
+    return (count > 0) ? count : 1;
+  }
+
+  void
+  submit(std::function<void()> task){
+    std::unique_lock<std::mutex> guard(lock);
+    spaceAvailable.wait(guard, [this]{ return (int)tasks.size() < maxQueued; });
+    tasks.push_back(task);
+    taskAvailable.notify_one();
+  }
+
+  void
+  waitIdle(void){
+    std::unique_lock<std::mutex> guard(lock);
+    allDone.wait(guard, [this]{ return tasks.empty()&&(running == 0); });
+  }
+
+  void
+  workerLoop(void){
+    while(true){
+      std::function<void()> task;
+      {
+	std::unique_lock<std::mutex> guard(lock);
+	taskAvailable.wait(guard, [this]{ return stopping||!tasks.empty(); });
+	if(tasks.empty()){
+	  return;
+	}
+	task = tasks.front();
+	tasks.pop_front();
+	running++;
+	spaceAvailable.notify_one();
+      }
+      task();
+      {
+	std::unique_lock<std::mutex> guard(lock);
+	running--;
+	if(tasks.empty()&&(running == 0)){
+	  allDone.notify_all();
+	}
+      }
+    }
+  }
+};
@@ -0,0 +1,162 @@
+//chess clocks for both sides and how long a search gets to spend out of them
+//an engine process gets the clocks as go wtime/btime and budgets itself, the built in search uses timeManager
+
+#include <time.h>
+
+#include <algorithm>
+
+long long
+clockNowMs(void){
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec*1000LL) + (ts.tv_nsec/1000000);
+}
+
+//one time control for both sides, "40/300+2" is 40 moves in 300 s plus 2 s a move, no moves/ is the whole game
+class gameClock {
+public:
+  bool running = false;//no time control, searches get a fixed time or depth instead
+  long long baseMs = 0;
+  long long incrementMs = 0;
+  int movesPerControl = 0;
+  long long remainingMs[2];//white, black
+  int movesMade[2];
+  bool flagged[2];
+  long long turnStartMs = 0;
+
+  gameClock(void){
+    reset();
+  }
+
+  //"[moves/]seconds[+increment]", seconds can have a fraction
+  bool
+  parse(const char* text){
+    int moves = 0;
+    double seconds = 0;
+    double increment = 0;
+    const char* slash = strchr(text, '/');
+    if(slash != NULL){
+      moves = atoi(text);
+      text = slash+1;
+    }
+    int numRead = sscanf(text, "%lf+%lf", &seconds, &increment);
+    if((numRead < 1)||(seconds <= 0)||(increment < 0)||(moves < 0)){
+      printf("time control must look like 300+2 or 40/300, not \"%s\"\n", text);
+      return false;
+    }
+    running = true;
+    baseMs = (long long)(seconds*1000);
+    incrementMs = (long long)(increment*1000);
+    movesPerControl = moves;
+    reset();
+    return true;
+  }
+
+  void
+  reset(void){
+    for(int side = 0; side < 2; side++){
+      remainingMs[side] = baseMs;
+      movesMade[side] = 0;
+      flagged[side] = false;
+    }
+    turnStartMs = clockNowMs();
+  }
+
+  //0 when the control runs to the end of the game, what uci's movestogo leaves out
+  int
+  movesToGo(bool isWhite){
+    if(movesPerControl == 0){
+      return 0;
+    }
+    return movesPerControl - (movesMade[isWhite ? 0 : 1] % movesPerControl);
+  }
+
+  //the side that just moved pays for its thinking and gets its increment, the other side's clock starts
+  void
+  endTurn(bool isWhite){
+    long long now = clockNowMs();
+    if(running){
+      int side = isWhite ? 0 : 1;
+      remainingMs[side] -= now-turnStartMs;
+      if(remainingMs[side] <= 0){
+	flagged[side] = true;
+      }else{
+	remainingMs[side] += incrementMs;
+      }
+      movesMade[side]++;
+      if((movesPerControl > 0)&&(movesMade[side] % movesPerControl == 0)){
+	remainingMs[side] += baseMs;
+      }
+    }
+    turnStartMs = now;
+  }
+};
+
+//soft limit: no new iteration starts past it, stretched while the best move keeps changing or the score is falling
+//hard limit: the search stops mid-iteration, whatever it was doing
+class timeManager {
+public:
+  static const long long overheadMs = 30;//pipes, thread joins, the gui, kept back every move
+  long long softMs = 0;//0 is no limit
+  long long hardMs = 0;
+  bool adaptive = false;
+  move lastBestMove;
+  int lastScore = 0;
+  int stableIterations = 0;
+
+  //budget from the clock of the side to move
+  void
+  startClocked(long long remainingMs, long long incrementMs, int movesToGo){
+    //a game with no moves/ control is assumed to have about 30 more moves in it, whatever the move number
+    int expectedMoves = (movesToGo > 0) ? std::min(movesToGo, 50) : 30;
+    long long usable = std::max(remainingMs - overheadMs, 10LL);
+    softMs = std::min(remainingMs/expectedMoves + incrementMs*3/4, usable*7/10);
+    hardMs = std::min(softMs*3, usable*8/10);
+    softMs = std::max(softMs, 1LL);
+    hardMs = std::max(hardMs, softMs);
+    adaptive = true;
+    startIterations();
+  }
+
+  //a fixed time a move, the next iteration isn't started past half of it since it costs several times the last
+  void
+  startFixed(long long moveTimeMs){
+    softMs = moveTimeMs/2;
+    hardMs = moveTimeMs;
+    adaptive = false;
+    startIterations();
+  }
+
+  void
+  startIterations(void){
+    lastBestMove = move();
+    lastScore = 0;
+    stableIterations = 0;
+  }
+
+  //after every finished iteration, true if the next one shouldn't start
+  bool
+  iterationDone(move bestMove, int score, long long elapsedMs){
+    if((bestMove.from == lastBestMove.from)&&(bestMove.to == lastBestMove.to)&&(bestMove.promotion == lastBestMove.promotion)){
+      stableIterations++;
+    }else{
+      stableIterations = 0;
+    }
+    int drop = (lastBestMove.from >= 0) ? (lastScore - score) : 0;
+    lastBestMove = bestMove;
+    lastScore = score;
+    if(softMs <= 0){
+      return false;
+    }
+    double scale = 1.0;
+    if(adaptive){
+      //a best move that just changed gets up to 1.3x, one that has held for several iterations as little as 0.5x
+      scale = std::max(0.5, 1.3 - 0.15*stableIterations);
+      //a score that fell gets up to 1.8x more to find something better
+      scale *= 1.0 + 0.8*std::min(std::max(drop, 0), 150)/150.0;
+      //the next iteration takes a couple of times this one, starting it past ~60% of the budget overshoots it
+      scale *= 0.6;
+    }
+    return elapsedMs >= std::min((long long)(softMs*scale), hardMs);
+  }
+};
@@ -0,0 +1,157 @@
+//timeline tracing written as chrome trace json (chrome://tracing, ui.perfetto.dev), only compiled in with -DTRACING
+//every thread writes into its own buffer so recording never takes a lock, buffers are only read when flushing
+
+#ifdef TRACING
+
+#include <time.h>
+
+#include <atomic>
+
+class traceEvent {
+public:
+  const char* name;
+  char phase;//'X' span, 'C' counter
+  long long startNs;
+  long long durationNs;
+  long long value;
+};
+
+class traceThreadBuffer {
+public:
+  static const int capacity = 1<<16;
+  traceEvent events[capacity];
+  std::atomic<int> count{0};
+  std::atomic<long long> dropped{0};
+  int threadId;
+  const char* threadName = NULL;
+  traceThreadBuffer* next = NULL;
+};
+
+std::atomic<traceThreadBuffer*> traceBuffers{NULL};
+std::atomic<int> traceNextThreadId{1};
+
+long long
+traceNowNs(void){
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec*1000000000LL) + ts.tv_nsec;
+}
+
+traceThreadBuffer*
+traceRegisterThread(void){
+  //never freed, the flush can still be reading it after the thread is gone
+  traceThreadBuffer* buffer = new traceThreadBuffer();
+  buffer->threadId = traceNextThreadId.fetch_add(1);
+  buffer->next = traceBuffers.load();
+  while(!traceBuffers.compare_exchange_weak(buffer->next, buffer)){
+  }
+  return buffer;
+}
+
+thread_local traceThreadBuffer* traceThisThread = NULL;
+
+void
+traceRecord(const char* name, char phase, long long startNs, long long durationNs, long long value){
+  if(traceThisThread == NULL){
+    traceThisThread = traceRegisterThread();
+  }
+  traceThreadBuffer* buffer = traceThisThread;
+  int index = buffer->count.load(std::memory_order_relaxed);
+  if(index >= traceThreadBuffer::capacity){
+    buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  traceEvent* e = &buffer->events[index];
+  e->name = name;
+  e->phase = phase;
+  e->startNs = startNs;
+  e->durationNs = durationNs;
+  e->value = value;
+  buffer->count.store(index+1, std::memory_order_release);
+}
+
+void
+traceSetThreadName(const char* name){
+  if(traceThisThread == NULL){
+    traceThisThread = traceRegisterThread();
+  }
+  traceThisThread->threadName = name;
+}
+
+class traceSpanScope {
+public:
+  const char* name;
+  long long startNs;
+
+  traceSpanScope(const char* name_){
+    name = name_;
+    startNs = traceNowNs();
+  }
+
+  ~traceSpanScope(void){
+    traceRecord(name, 'X', startNs, traceNowNs()-startNs, 0);
+  }
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SPAN(name) traceSpanScope TRACE_CONCAT(traceSpanScope_, __LINE__)(name)
+#define TRACE_COUNTER(name, value) traceRecord(name, 'C', traceNowNs(), 0, value)
+#define TRACE_THREAD_NAME(name) traceSetThreadName(name)
+
+//safe to call while other threads are still recording, it only reads events they have finished writing
+void
+traceFlush(const char* filename){
+  FILE* f = fopen(filename, "w");
+  if(f == NULL){
+    printf("failed to open trace file \"%s\": %s\n", filename, strerror(errno));
+    return;
+  }
+  int pid = getpid();
+  long long totalEvents = 0;
+  long long totalDropped = 0;
+  bool first = true;
+  fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+  for(traceThreadBuffer* buffer = traceBuffers.load(); buffer != NULL; buffer = buffer->next){
+    if(buffer->threadName != NULL){
+      fprintf(f, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"%s\"}}", first ? "" : ",\n", pid, buffer->threadId, buffer->threadName);
+      first = false;
+    }
+    int count = buffer->count.load(std::memory_order_acquire);
+    for(int i = 0; i < count; i++){
+      traceEvent* e = &buffer->events[i];
+      if(e->phase == 'X'){
+	fprintf(f, "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": %d, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}", first ? "" : ",\n", e->name, pid, buffer->threadId, e->startNs/1000.0, e->durationNs/1000.0);
+      }else{
+	fprintf(f, "%s{\"name\": \"%s\", \"ph\": \"C\", \"pid\": %d, \"tid\": %d, \"ts\": %.3f, \"args\": {\"value\": %lld}}", first ? "" : ",\n", e->name, pid, buffer->threadId, e->startNs/1000.0, e->value);
+      }
+      first = false;
+    }
+    totalEvents += count;
+    totalDropped += buffer->dropped.load();
+  }
+  fprintf(f, "\n]}\n");
+  fclose(f);
+  printf("wrote %lld trace events to \"%s\"", totalEvents, filename);
+  if(totalDropped > 0){
+    printf(", %lld dropped because a thread buffer was full", totalDropped);
+  }
+  printf("\n");
+}
+
+const char*
+traceFilename(void){
+  const char* filename = getenv("CHESS_TRACE_FILE");
+  if(filename == NULL){
+    filename = "trace.json";
+  }
+  return filename;
+}
+
+#else
+
+#define TRACE_SPAN(name)
+#define TRACE_COUNTER(name, value)
+#define TRACE_THREAD_NAME(name)
+
+#endif
@@ -0,0 +1,171 @@
+//transposition table for the in-process search, shared by every search thread without locks
+//an entry is two words and the key is stored xor'd with the data, a torn write from another thread just reads as a miss
+
+#include <stdint.h>
+
+#include <atomic>
+
+enum {
+  ttBound_none,
+  ttBound_upper,//failed low, real score <= stored
+  ttBound_lower,//failed high, real score >= stored
+  ttBound_exact
+};
+
+//data word: move 0-15, score 16-31, depth+1 32-39 (never 0 so empty entries are all zeros), bound 40-41, generation 42-47
+const int ttGenerationMask = 63;
+
+class ttEntry {
+public:
+  std::atomic<uint64_t> keyXorData;
+  std::atomic<uint64_t> data;
+};
+
+//4 entries to a bucket, one cache line, a probe touches nothing else
+class alignas(64) ttBucket {
+public:
+  static const int numEntries = 4;
+  ttEntry entries[numEntries];
+};
+
+//what a probe found, unpacked
+class ttHit {
+public:
+  move bestMove;
+  int score;
+  int depth;
+  int bound;
+};
+
+const char ttPromotions[5] = {'\0', 'q', 'r', 'b', 'n'};
+
+uint64_t
+ttPackMove(move m){
+  if(m.from < 0){
+    return 0;//from == to == 0 is never a real move
+  }
+  int promotion = 0;
+  for(int i = 1; i < 5; i++){
+    if(m.promotion == ttPromotions[i]){
+      promotion = i;
+    }
+  }
+  return m.from | (m.to << 6) | (promotion << 12);
+}
+
+move
+ttUnpackMove(uint64_t packed){
+  if(packed == 0){
+    return move();
+  }
+  move m(packed & 63, (packed >> 6) & 63);
+  m.promotion = ttPromotions[(packed >> 12) & 7];
+  return m;
+}
+
+class transpositionTable {
+public:
+  largeBuffer memory;
+  ttBucket* buckets = NULL;
+  uint64_t numBuckets = 0;
+  int generation = 0;
+
+  void
+  resize(int megabytes){
+    numBuckets = ((uint64_t)megabytes*1024*1024)/sizeof(ttBucket);
+    if(numBuckets == 0){
+      numBuckets = 1;
+    }
+    buckets = (ttBucket*)memory.allocate(numBuckets*sizeof(ttBucket));
+    if(buckets == NULL){
+      printf("failed to allocate %d MB transposition table\n", megabytes);
+      exit(1);
+    }
+    clear();
+  }
+
+  //only while nothing is searching
+  void
+  clear(void){
+    memory.zero();
+    generation = 0;
+  }
+
+  //entries from earlier searches lose replacement fights and stop counting toward hashfull
+  void
+  newSearch(void){
+    generation = (generation+1) & ttGenerationMask;
+  }
+
+  ttBucket*
+  bucketFor(uint64_t key){
+    return &buckets[(uint64_t)(((unsigned __int128)key*numBuckets) >> 64)];
+  }
+
+  bool
+  probe(uint64_t key, ttHit* hit){
+    ttBucket* bucket = bucketFor(key);
+    for(int i = 0; i < ttBucket::numEntries; i++){
+      uint64_t data = bucket->entries[i].data.load(std::memory_order_relaxed);
+      uint64_t keyXorData = bucket->entries[i].keyXorData.load(std::memory_order_relaxed);
+      if((data != 0)&&((keyXorData ^ data) == key)){
+	hit->bestMove = ttUnpackMove(data & 0xFFFF);
+	hit->score = (int16_t)((data >> 16) & 0xFFFF);
+	hit->depth = (int)((data >> 32) & 0xFF) - 1;
+	hit->bound = (data >> 40) & 3;
+	return true;
+      }
+    }
+    return false;
+  }
+
+  void
+  store(uint64_t key, move bestMove, int score, int depth, int bound){
+    ttBucket* bucket = bucketFor(key);
+    //same position if it's there, otherwise the shallowest, oldest entry goes
+    ttEntry* replace = NULL;
+    int replaceWorth = 1 << 30;
+    uint64_t oldData = 0;
+    for(int i = 0; i < ttBucket::numEntries; i++){
+      ttEntry* entry = &bucket->entries[i];
+      uint64_t data = entry->data.load(std::memory_order_relaxed);
+      if((data != 0)&&((entry->keyXorData.load(std::memory_order_relaxed) ^ data) == key)){
+	replace = entry;
+	oldData = data;
+	break;
+      }
+      int age = (generation - (int)((data >> 42) & ttGenerationMask)) & ttGenerationMask;
+      int worth = (data == 0) ? -(1 << 20) : ((int)((data >> 32) & 0xFF) - 8*age);
+      if(worth < replaceWorth){
+	replace = entry;
+	replaceWorth = worth;
+      }
+    }
+    uint64_t packedMove = ttPackMove(bestMove);
+    if(packedMove == 0){
+      packedMove = oldData & 0xFFFF;//a fail low has no move, keep the one we had
+    }
+    if(depth > 253){
+      depth = 253;
+    }
+    uint64_t data = packedMove | ((uint64_t)(uint16_t)score << 16) | ((uint64_t)(depth+1) << 32) | ((uint64_t)bound << 40) | ((uint64_t)generation << 42);
+    replace->data.store(data, std::memory_order_relaxed);
+    replace->keyXorData.store(key ^ data, std::memory_order_relaxed);
+  }
+
+  //permille of a sample of entries written this search, the same unit uci's "info hashfull" uses
+  int
+  hashfull(void){
+    uint64_t sampled = (numBuckets < 250) ? numBuckets : 250;
+    int used = 0;
+    for(uint64_t b = 0; b < sampled; b++){
+      for(int i = 0; i < ttBucket::numEntries; i++){
+	uint64_t data = buckets[b].entries[i].data.load(std::memory_order_relaxed);
+	if((data != 0)&&((int)((data >> 42) & ttGenerationMask) == generation)){
+	  used++;
+	}
+      }
+    }
+    return used*1000/(sampled*ttBucket::numEntries);
+  }
+};